@@ -0,0 +1,87 @@
+// Count heap allocations, for --clip
+#define CE3D_COUNT_ALLOCATIONS
+#include "../ConsoleEngine3D/ConsoleEngine3D.h"
+
+// End-to-end frame benchmark for ConsoleEngine3D. Renders offscreen, so it
+// runs anywhere, and the camera path and timestep are fixed, so runs of the
+// same build can be compared across commits. See RunFrameBenchmark().
+//
+//	Benchmark [--model <obj>] [--frames <n>] [--warmup <n>] [--grid] [--painter] [--out <json file>] [--trace <json file>]
+//
+// The JSON goes to standard output unless --out is given. Built with OLC_TRACE
+// defined, --trace also saves the stage zones of the last frames as a Chrome
+// trace, for chrome://tracing or Perfetto.
+//
+//	Benchmark --clip [--model <obj>]
+//
+// runs the clipper microbenchmark instead, see RunClipBenchmark().
+int main(int argc, char *argv[])
+{
+	std::string sModel = "teapot.obj";
+	int nFrames = 1000;
+	int nWarmup = 10;
+	bool bGrid = false;
+	bool bPainter = false;
+	bool bClip = false;
+	const char *sOut = nullptr;
+	const char *sTrace = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool bValue = i + 1 < argc;
+		if (strcmp(argv[i], "--model") == 0 && bValue)
+			sModel = argv[++i];
+		else if (strcmp(argv[i], "--frames") == 0 && bValue)
+			nFrames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--warmup") == 0 && bValue)
+			nWarmup = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--out") == 0 && bValue)
+			sOut = argv[++i];
+		else if (strcmp(argv[i], "--trace") == 0 && bValue)
+			sTrace = argv[++i];
+		else if (strcmp(argv[i], "--grid") == 0)
+			bGrid = true;
+		else if (strcmp(argv[i], "--painter") == 0)
+			bPainter = true;
+		else if (strcmp(argv[i], "--clip") == 0)
+			bClip = true;
+		else
+		{
+			fprintf(stderr, "Usage: Benchmark [--model <obj>] [--frames <n>] [--warmup <n>] [--grid] [--painter] [--out <json file>] [--trace <json file>]\n");
+			fprintf(stderr, "       Benchmark --clip [--model <obj>]\n");
+			return 1;
+		}
+	}
+
+	if (bClip)
+	{
+		ConsoleEngine3D demo(sModel);
+		return demo.RunClipBenchmark();
+	}
+
+	FILE *pJson = stdout;
+	if (sOut != nullptr)
+	{
+		_wfopen_s(&pJson, std::filesystem::path(sOut).wstring().c_str(), L"w");
+		if (pJson == nullptr)
+		{
+			fprintf(stderr, "Cannot write %s\n", sOut);
+			return 1;
+		}
+	}
+
+	ConsoleEngine3D demo(sModel);
+	int nResult = 1;
+	if (demo.ConstructHeadless(256, 240, 1))
+		nResult = demo.RunFrameBenchmark(nFrames, nWarmup, 1.0f / 60.0f, bGrid, bPainter, pJson);
+
+	if (pJson != stdout)
+		fclose(pJson);
+
+	if (sTrace != nullptr && !demo.SaveTrace(std::filesystem::path(sTrace).wstring()))
+	{
+		fprintf(stderr, "Cannot write %s (is OLC_TRACE defined?)\n", sTrace);
+		return 1;
+	}
+	return nResult;
+}
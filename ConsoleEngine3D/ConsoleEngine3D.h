@@ -0,0 +1,3319 @@
+#pragma once
+
+// The whole demo, shared by its own executable and the benchmark. Like
+// olcConsoleGameEngine.h, include it from only one source file per program.
+
+#include "olcConsoleGameEngine.h"
+
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <cstdint>
+#include <charconv>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <unordered_map>
+#include <type_traits>
+#include <numeric>
+#include <iterator>
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CE3D_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CE3D_TARGET(isa)
+#else
+#define CE3D_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+// Defining CE3D_COUNT_ALLOCATIONS before including this replaces the global
+// allocator with one that counts every heap allocation, so the clipper
+// benchmark can count how many a frame makes. Only the Benchmark project
+// does; the demo itself keeps the standard allocator.
+#ifdef CE3D_COUNT_ALLOCATIONS
+static std::atomic<uint64_t> nHeapAllocations{ 0 };
+
+#ifdef _MSC_VER
+#define CE3D_NOINLINE __declspec(noinline)
+#else
+#define CE3D_NOINLINE __attribute__((noinline))
+#endif
+
+// Every form of new ends up here, aligned or not, so every form of delete can
+// free the same way
+static void *CountedAlloc(size_t nBytes, size_t nAlign)
+{
+	nHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	nAlign = (std::max)(nAlign, alignof(std::max_align_t));
+#ifdef _MSC_VER
+	return _aligned_malloc(nBytes ? nBytes : 1, nAlign);
+#else
+	void *p = nullptr;
+	return posix_memalign(&p, (std::max)(nAlign, sizeof(void *)), nBytes ? nBytes : 1) == 0 ? p : nullptr;
+#endif
+}
+
+// Kept out of line, so the compiler never sees a new paired with free()
+static CE3D_NOINLINE void CountedFree(void *p) noexcept
+{
+#ifdef _MSC_VER
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+void *operator new(size_t nBytes)
+{
+	if (void *p = CountedAlloc(nBytes, 0))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](size_t nBytes)
+{
+	if (void *p = CountedAlloc(nBytes, 0))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new(size_t nBytes, std::align_val_t nAlign)
+{
+	if (void *p = CountedAlloc(nBytes, (size_t)nAlign))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](size_t nBytes, std::align_val_t nAlign)
+{
+	if (void *p = CountedAlloc(nBytes, (size_t)nAlign))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new(size_t nBytes, const std::nothrow_t &) noexcept { return CountedAlloc(nBytes, 0); }
+void *operator new[](size_t nBytes, const std::nothrow_t &) noexcept { return CountedAlloc(nBytes, 0); }
+void *operator new(size_t nBytes, std::align_val_t nAlign, const std::nothrow_t &) noexcept { return CountedAlloc(nBytes, (size_t)nAlign); }
+void *operator new[](size_t nBytes, std::align_val_t nAlign, const std::nothrow_t &) noexcept { return CountedAlloc(nBytes, (size_t)nAlign); }
+
+CE3D_NOINLINE void operator delete(void *p) noexcept { CountedFree(p); }
+CE3D_NOINLINE void operator delete[](void *p) noexcept { CountedFree(p); }
+CE3D_NOINLINE void operator delete(void *p, size_t) noexcept { CountedFree(p); }
+CE3D_NOINLINE void operator delete[](void *p, size_t) noexcept { CountedFree(p); }
+CE3D_NOINLINE void operator delete(void *p, std::align_val_t) noexcept { CountedFree(p); }
+CE3D_NOINLINE void operator delete[](void *p, std::align_val_t) noexcept { CountedFree(p); }
+CE3D_NOINLINE void operator delete(void *p, size_t, std::align_val_t) noexcept { CountedFree(p); }
+CE3D_NOINLINE void operator delete[](void *p, size_t, std::align_val_t) noexcept { CountedFree(p); }
+CE3D_NOINLINE void operator delete(void *p, const std::nothrow_t &) noexcept { CountedFree(p); }
+CE3D_NOINLINE void operator delete[](void *p, const std::nothrow_t &) noexcept { CountedFree(p); }
+CE3D_NOINLINE void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { CountedFree(p); }
+CE3D_NOINLINE void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { CountedFree(p); }
+#endif
+
+struct vec3d
+{
+	float x = 0.0f;
+	float y = 0.0f;
+	float z = 0.0f;
+	float w = 1.0f;
+};
+
+struct triangle
+{
+	vec3d p[3];
+
+	wchar_t sym;
+	short col;
+	float lum[3];	// per-vertex light, for Gouraud shading
+};
+
+// Packed vertex, exactly as it is stored in the mesh cache file
+struct vec3f
+{
+	float x = 0.0f;
+	float y = 0.0f;
+	float z = 0.0f;
+};
+
+// Binary mesh cache ==========================================================
+//
+// Parsing a large .obj as text on every startup is slow, so the first load writes
+// a packed binary copy next to it ("teapot.obj" -> "teapot.obj.bin"). Later runs
+// map that file straight into memory and point the mesh at it - nothing is parsed
+// or copied. The cache is rebuilt whenever the .obj is newer than it.
+//
+// Layout: meshCacheHeader, a table of nSections meshCacheSection entries, then
+// each section's payload on a 16 byte boundary. Everything is stored exactly as
+// it is used in memory (little-endian), so unknown sections are simply skipped.
+// The simplified LOD levels are stored the same way as the full mesh, with the
+// level number (1 for the first simplified one) shifted into the section id.
+
+enum MESH_CACHE_SECTION
+{
+	MESH_SECTION_INDICES		= 2, // uint32_t[nIndices], three per triangle
+	MESH_SECTION_FACE_NORMALS	= 3, // vec3f[nIndices / 3], unit length
+	MESH_SECTION_VERTEX_X		= 4, // float[nVerts]
+	MESH_SECTION_VERTEX_Y		= 5, // float[nVerts]
+	MESH_SECTION_VERTEX_Z		= 6, // float[nVerts]
+	MESH_SECTION_BVH_NODES		= 7, // bvhNode[nBvhNodes]
+	MESH_SECTION_LODS			= 8, // meshCacheLevel[nLods], levels 1 and up
+	MESH_SECTION_VERTEX_NORMALS	= 9, // vec3f[nVerts], unit length
+};
+
+static const uint32_t MESH_SECTION_LEVEL_SHIFT = 8;
+
+struct meshCacheHeader
+{
+	char magic[4];			// "CE3M"
+	uint32_t nVersion;		// bumped whenever the meaning of a section changes
+	uint32_t nSections;
+	uint32_t nVerts;
+	uint32_t nIndices;
+	vec3f vBoundsMin;
+	vec3f vBoundsMax;
+	uint32_t nBvhNodes;
+	uint32_t nLods;			// simplified levels after the full mesh
+	uint32_t nReserved[3];	// pads the header to 64 bytes, so the table's 64 bit fields are aligned
+};
+static_assert(sizeof(meshCacheHeader) % 16 == 0, "the section table must start aligned");
+
+// Sizes of one LOD level's sections, and what it needs besides them
+struct meshCacheLevel
+{
+	uint32_t nVerts;
+	uint32_t nIndices;
+	uint32_t nBvhNodes;
+	float fLodError;
+	vec3f vBoundsMin;
+	vec3f vBoundsMax;
+};
+
+struct meshCacheSection
+{
+	uint32_t nId;
+	uint32_t nReserved;
+	uint64_t nOffset;		// from start of file
+	uint64_t nBytes;
+};
+
+static const uint32_t MESH_CACHE_VERSION = 8;
+
+// Read-only view of a whole file, unmapped when the last mesh using it goes away
+class mappedFile
+{
+public:
+#ifdef _WIN32
+	~mappedFile()
+	{
+		if (m_pData != nullptr) UnmapViewOfFile(m_pData);
+		if (m_hMapping != nullptr) CloseHandle(m_hMapping);
+		if (m_hFile != INVALID_HANDLE_VALUE) CloseHandle(m_hFile);
+	}
+
+	bool Open(const std::string &sFile)
+	{
+		m_hFile = CreateFileA(sFile.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_hFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_hFile, &size) || size.QuadPart == 0)
+			return false;
+
+		m_hMapping = CreateFileMappingA(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_hMapping == nullptr)
+			return false;
+
+		m_pData = MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+		m_nSize = (size_t)size.QuadPart;
+		return m_pData != nullptr;
+	}
+#else
+	~mappedFile()
+	{
+		if (m_pData != nullptr) munmap(m_pData, m_nSize);
+		if (m_nFile >= 0) close(m_nFile);
+	}
+
+	bool Open(const std::string &sFile)
+	{
+		m_nFile = open(sFile.c_str(), O_RDONLY);
+		if (m_nFile < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(m_nFile, &st) != 0 || st.st_size == 0)
+			return false;
+
+		void *pData = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, m_nFile, 0);
+		if (pData == MAP_FAILED)
+			return false;
+
+		m_pData = pData;
+		m_nSize = (size_t)st.st_size;
+		return true;
+	}
+#endif
+
+	const char *Data() const { return (const char*)m_pData; }
+	size_t Size() const { return m_nSize; }
+
+private:
+#ifdef _WIN32
+	HANDLE m_hFile = INVALID_HANDLE_VALUE;
+	HANDLE m_hMapping = nullptr;
+#else
+	int m_nFile = -1;
+#endif
+	void *m_pData = nullptr;
+	size_t m_nSize = 0;
+};
+
+// One chunk's worth of a parallel .obj parse, before it is merged with the rest
+struct objChunk
+{
+	std::vector<vec3f> verts;
+	std::vector<int32_t> indices;		// raw .obj position indices, three per triangle
+	std::vector<uint32_t> vertsSeen;	// vertices this chunk had read before each triangle
+};
+
+// Node of a bounding volume hierarchy over a mesh's triangles. The triangles
+// are reordered when it is built so that every node, inner or leaf, covers one
+// contiguous run of them. Children are stored as a pair, always after their
+// parent. Vertices are renumbered in order of first use by those triangles, so
+// each node's vertices mostly sit in a narrow range too.
+struct bvhNode
+{
+	vec3f vMin;
+	vec3f vMax;
+	uint32_t nLeft;			// index of the first child, the second follows it. 0 for a leaf.
+	uint32_t nTriFirst;		// triangles under this node
+	uint32_t nTriCount;
+	uint32_t nVertFirst;	// [nVertFirst, nVertEnd) holds every vertex they use
+	uint32_t nVertEnd;
+};
+
+// Error quadric (Garland & Heckbert): a sum of planes, whose value at a point
+// is the sum of the squared distances from the point to each of them. Only
+// the upper triangle of the symmetric 4x4 matrix is kept.
+struct quadric
+{
+	double xx = 0, xy = 0, xz = 0, xw = 0;
+	double yy = 0, yz = 0, yw = 0;
+	double zz = 0, zw = 0;
+	double ww = 0;
+
+	// Plane ax + by + cz + d = 0, with (a, b, c) unit length
+	void AddPlane(double a, double b, double c, double d, double fWeight)
+	{
+		xx += fWeight * a * a; xy += fWeight * a * b; xz += fWeight * a * c; xw += fWeight * a * d;
+		yy += fWeight * b * b; yz += fWeight * b * c; yw += fWeight * b * d;
+		zz += fWeight * c * c; zw += fWeight * c * d;
+		ww += fWeight * d * d;
+	}
+
+	void Add(const quadric &q)
+	{
+		xx += q.xx; xy += q.xy; xz += q.xz; xw += q.xw;
+		yy += q.yy; yz += q.yz; yw += q.yw;
+		zz += q.zz; zw += q.zw;
+		ww += q.ww;
+	}
+
+	double Error(double x, double y, double z) const
+	{
+		double e = xx * x * x + yy * y * y + zz * z * z + ww +
+			2.0 * (xy * x * y + xz * x * z + yz * y * z + xw * x + yw * y + zw * z);
+		return max(0.0, e); // it can't really be negative, but rounding says otherwise
+	}
+
+	// The point of least error, unless the planes don't pin one down (all
+	// parallel, or all through one line)
+	bool Minimum(double &x, double &y, double &z) const
+	{
+		double c00 = yy * zz - yz * yz;
+		double c01 = xz * yz - xy * zz;
+		double c02 = xy * yz - xz * yy;
+		double det = xx * c00 + xy * c01 + xz * c02;
+		double fScale = xx + yy + zz;
+		if (fabs(det) <= 1e-9 * fScale * fScale * fScale)
+			return false;
+
+		double c11 = xx * zz - xz * xz;
+		double c12 = xy * xz - xx * yz;
+		double c22 = xx * yy - xy * xy;
+		x = -(c00 * xw + c01 * yw + c02 * zw) / det;
+		y = -(c01 * xw + c11 * yw + c12 * zw) / det;
+		z = -(c02 * xw + c12 * yw + c22 * zw) / det;
+		return true;
+	}
+};
+
+// Indexed triangle mesh. Vertices shared between triangles are stored once
+// (welded at load time) and triangles refer to them by 32-bit index, so the
+// renderer can transform each vertex once per frame however many triangles use it
+struct mesh
+{
+	// Packed geometry. These point either into the vectors below, for a freshly
+	// parsed .obj, or straight into the memory-mapped cache file. Positions are
+	// kept as separate x/y/z arrays so they can be fed to TransformPoints as-is.
+	const float *pVertX = nullptr;
+	const float *pVertY = nullptr;
+	const float *pVertZ = nullptr;
+	const uint32_t *pIndices = nullptr;
+	const vec3f *pFaceNormals = nullptr;
+	const vec3f *pVertNormals = nullptr;
+	uint32_t nVerts = 0;
+	uint32_t nIndices = 0;
+	vec3f vBoundsMin;
+	vec3f vBoundsMax;
+
+	std::vector<vec3f> vecVerts;		// positions as parsed, before welding
+	std::vector<float> vecVertX;
+	std::vector<float> vecVertY;
+	std::vector<float> vecVertZ;
+	std::vector<uint32_t> vecIndices;
+	std::vector<vec3f> vecFaceNormals;
+	std::vector<vec3f> vecVertNormals;
+	std::shared_ptr<mappedFile> cacheMapping;
+
+	// Bounding volume hierarchy, root first. Always our own copy, even when
+	// loaded from the cache, so that it can be refitted.
+	static constexpr uint32_t nBvhLeafSize = 16;
+	std::vector<bvhNode> vecBvh;
+	float fBvhBuildMs = -1.0f; // how long BuildBvh took, -1 if it came from the cache
+	static constexpr uint32_t nMaxBvhDepth = 63; // deepest tree CullBvh can walk
+
+	// Simplified copies of the mesh, each with about half the triangles of the
+	// one before, built by BuildLods and saved in the cache with it. Each is a
+	// complete mesh of its own, BVH and all. fLodError is how far, in model
+	// units, a level may stray from the full mesh; 0 for the full mesh itself.
+	static constexpr uint32_t nMaxLods = 6;
+	static constexpr uint32_t nLodMinTriangles = 64;
+	std::vector<mesh> vecLods;
+	float fLodError = 0.0f;
+	float fLodBuildMs = -1.0f; // how long BuildLods took, -1 if they came from the cache
+
+	mesh() = default;
+	mesh(mesh&&) = default;
+	mesh &operator=(mesh&&) = default;
+
+	// The views above may point into our own vectors, so a copy would alias them
+	mesh(const mesh&) = delete;
+	mesh &operator=(const mesh&) = delete;
+
+	bool LoadFromObjFile(std::string _fileName)
+	{
+		std::string sCacheFile = _fileName + ".bin";
+
+		// Use the cache unless the .obj has been touched since it was written
+		std::error_code ec;
+		auto tpObj = std::filesystem::last_write_time(_fileName, ec);
+		bool bHaveObj = !ec;
+		auto tpCache = std::filesystem::last_write_time(sCacheFile, ec);
+		bool bHaveCache = !ec;
+
+		if (bHaveCache && (!bHaveObj || tpCache >= tpObj) && LoadFromCacheFile(sCacheFile))
+			return true;
+
+		if (!bHaveObj || !ParseObjFile(_fileName))
+			return false;
+
+		WeldVertices();
+		ComputeFaceNormalsAndBounds();
+		BuildBvh();
+		ComputeVertexNormals();
+		BuildLods();
+		SaveToCacheFile(sCacheFile);
+		return true;
+	}
+
+	// Reads the whole .obj in parallel. The file is cut into newline-aligned chunks,
+	// one per core, and each chunk is parsed into its own vertex and triangle lists.
+	// Chunks are then stitched back together in file order, which is when relative
+	// (negative) indices can finally be resolved. Polygons are fanned into
+	// triangles; texture and normal indices in "v/vt/vn" references are skipped.
+	bool ParseObjFile(const std::string &_fileName)
+	{
+		mappedFile file;
+		if (!file.Open(_fileName))
+		{
+			// File cannot be found
+			return false;
+		}
+
+		const char *pFile = file.Data();
+		const size_t nFileSize = file.Size();
+
+		// Don't bother spinning up threads for small files
+		const size_t nMinChunkSize = 1 << 20;
+		size_t nChunks = max(1u, std::thread::hardware_concurrency());
+		nChunks = min(nChunks, max((size_t)1, nFileSize / nMinChunkSize));
+
+		std::vector<const char*> vecChunkStart(nChunks + 1);
+		vecChunkStart[0] = pFile;
+		vecChunkStart[nChunks] = pFile + nFileSize;
+		for (size_t c = 1; c < nChunks; c++)
+		{
+			const char *p = max(vecChunkStart[c - 1], pFile + nFileSize * c / nChunks);
+			const char *nl = (const char*)memchr(p, '\n', pFile + nFileSize - p);
+			vecChunkStart[c] = nl ? nl + 1 : pFile + nFileSize;
+		}
+
+		std::vector<objChunk> vecChunks(nChunks);
+		{
+			std::vector<std::thread> vecWorkers;
+			for (size_t c = 1; c < nChunks; c++)
+				vecWorkers.emplace_back(ParseObjChunk, vecChunkStart[c], vecChunkStart[c + 1], std::ref(vecChunks[c]));
+			ParseObjChunk(vecChunkStart[0], vecChunkStart[1], vecChunks[0]);
+			for (auto &t : vecWorkers)
+				t.join();
+		}
+
+		// Where each chunk's vertices and triangles land in the merged arrays
+		std::vector<size_t> vecVertBase(nChunks + 1, 0), vecIndexBase(nChunks + 1, 0);
+		for (size_t c = 0; c < nChunks; c++)
+		{
+			vecVertBase[c + 1] = vecVertBase[c] + vecChunks[c].verts.size();
+			vecIndexBase[c + 1] = vecIndexBase[c] + vecChunks[c].indices.size();
+		}
+		if (vecVertBase[nChunks] > UINT32_MAX || vecIndexBase[nChunks] > UINT32_MAX)
+			return false;
+
+		vecVerts.resize(vecVertBase[nChunks]);
+		vecIndices.resize(vecIndexBase[nChunks]);
+
+		const int64_t nTotalVerts = (int64_t)vecVertBase[nChunks];
+		std::atomic<bool> bAnyInvalid = false;
+		auto merge = [&](size_t c)
+		{
+			const objChunk &chunk = vecChunks[c];
+			std::copy(chunk.verts.begin(), chunk.verts.end(), vecVerts.begin() + vecVertBase[c]);
+
+			bool bInvalid = false;
+			for (size_t i = 0; i < chunk.indices.size(); i++)
+			{
+				// Positive indices are 1-based from the start of the file, negative
+				// ones count back from the last vertex read before this face
+				int64_t nRaw = chunk.indices[i];
+				int64_t nIndex = nRaw > 0 ? nRaw - 1 : (int64_t)vecVertBase[c] + chunk.vertsSeen[i / 3] + nRaw;
+				if (nRaw == 0 || nIndex < 0 || nIndex >= nTotalVerts)
+				{
+					nIndex = UINT32_MAX;
+					bInvalid = true;
+				}
+				vecIndices[vecIndexBase[c] + i] = (uint32_t)nIndex;
+			}
+			if (bInvalid)
+				bAnyInvalid = true;
+		};
+		{
+			std::vector<std::thread> vecWorkers;
+			for (size_t c = 1; c < nChunks; c++)
+				vecWorkers.emplace_back(merge, c);
+			merge(0);
+			for (auto &t : vecWorkers)
+				t.join();
+		}
+
+		// Drop triangles referring to vertices that don't exist
+		if (bAnyInvalid)
+		{
+			size_t nOut = 0;
+			for (size_t i = 0; i + 2 < vecIndices.size(); i += 3)
+			{
+				if (vecIndices[i] == UINT32_MAX || vecIndices[i + 1] == UINT32_MAX || vecIndices[i + 2] == UINT32_MAX)
+					continue;
+				vecIndices[nOut++] = vecIndices[i];
+				vecIndices[nOut++] = vecIndices[i + 1];
+				vecIndices[nOut++] = vecIndices[i + 2];
+			}
+			vecIndices.resize(nOut);
+		}
+
+		pIndices = vecIndices.data();
+		nVerts = (uint32_t)vecVerts.size();
+		nIndices = (uint32_t)vecIndices.size();
+		return true;
+	}
+
+	static void ParseObjChunk(const char *p, const char *pEnd, objChunk &chunk)
+	{
+		auto isBlank = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+		auto skipBlank = [&]() { while (p < pEnd && isBlank(*p)) p++; };
+		auto skipLine = [&]()
+		{
+			const char *nl = (const char*)memchr(p, '\n', pEnd - p);
+			p = nl ? nl + 1 : pEnd;
+		};
+		auto parseFloat = [&](float &f)
+		{
+			skipBlank();
+			if (p < pEnd && *p == '+') p++; // from_chars doesn't accept a leading '+'
+			auto r = std::from_chars(p, pEnd, f);
+			p = r.ptr;
+			return r.ec == std::errc();
+		};
+
+		std::vector<int32_t> polygon;
+
+		while (p < pEnd)
+		{
+			skipBlank();
+			if (pEnd - p < 2 || !isBlank(p[1]))
+			{
+				// Not a "v" or "f" statement - vt, vn, o, g, usemtl, comments etc.
+				skipLine();
+				continue;
+			}
+
+			if (p[0] == 'v')
+			{
+				p++;
+				vec3f v;
+				if (parseFloat(v.x) && parseFloat(v.y) && parseFloat(v.z))
+					chunk.verts.push_back(v);
+			}
+			else if (p[0] == 'f')
+			{
+				p++;
+				polygon.clear();
+				for (;;)
+				{
+					skipBlank();
+					int32_t nIndex = 0;
+					auto r = std::from_chars(p, pEnd, nIndex);
+					if (r.ec != std::errc())
+						break;
+					polygon.push_back(nIndex);
+
+					// Skip the "/vt/vn" part of the reference
+					p = r.ptr;
+					while (p < pEnd && !isBlank(*p) && *p != '\n')
+						p++;
+				}
+
+				// Fan the polygon into triangles
+				for (size_t k = 1; k + 1 < polygon.size(); k++)
+				{
+					chunk.indices.push_back(polygon[0]);
+					chunk.indices.push_back(polygon[k]);
+					chunk.indices.push_back(polygon[k + 1]);
+					chunk.vertsSeen.push_back((uint32_t)chunk.verts.size());
+				}
+			}
+
+			skipLine();
+		}
+	}
+
+	void ComputeFaceNormalsAndBounds()
+	{
+		vecFaceNormals.resize(nIndices / 3);
+		for (uint32_t i = 0; i < nIndices; i += 3)
+		{
+			vec3f a = GetVertex(pIndices[i + 0]);
+			vec3f b = GetVertex(pIndices[i + 1]);
+			vec3f c = GetVertex(pIndices[i + 2]);
+
+			// Same winding as the per-frame normal in OnUserUpdate
+			vec3f l1 = { b.x - a.x, b.y - a.y, b.z - a.z };
+			vec3f l2 = { c.x - a.x, c.y - a.y, c.z - a.z };
+			vec3f n = { l1.y * l2.z - l1.z * l2.y, l1.z * l2.x - l1.x * l2.z, l1.x * l2.y - l1.y * l2.x };
+			float l = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+			if (l > 0.0f)
+				n = { n.x / l, n.y / l, n.z / l };
+			vecFaceNormals[i / 3] = n;
+		}
+		pFaceNormals = vecFaceNormals.data();
+
+		vBoundsMin = vBoundsMax = vec3f();
+		if (nVerts > 0)
+			vBoundsMin = vBoundsMax = GetVertex(0);
+		for (uint32_t i = 1; i < nVerts; i++)
+		{
+			vBoundsMin = { min(vBoundsMin.x, pVertX[i]), min(vBoundsMin.y, pVertY[i]), min(vBoundsMin.z, pVertZ[i]) };
+			vBoundsMax = { max(vBoundsMax.x, pVertX[i]), max(vBoundsMax.y, pVertY[i]), max(vBoundsMax.z, pVertZ[i]) };
+		}
+	}
+
+	// Smooth normals for lighting at the vertices: the normals of the triangles
+	// around each vertex, weighted by area. As vertices are welded, this smooths
+	// over seams the file had too. Vertices must already be in their final order.
+	void ComputeVertexNormals()
+	{
+		std::vector<vec3f> vecSum(nVerts);
+		for (uint32_t i = 0; i < nIndices; i += 3)
+		{
+			vec3f a = GetVertex(pIndices[i + 0]);
+			vec3f b = GetVertex(pIndices[i + 1]);
+			vec3f c = GetVertex(pIndices[i + 2]);
+
+			// Not normalised, so its length is twice the area
+			vec3f l1 = { b.x - a.x, b.y - a.y, b.z - a.z };
+			vec3f l2 = { c.x - a.x, c.y - a.y, c.z - a.z };
+			vec3f n = { l1.y * l2.z - l1.z * l2.y, l1.z * l2.x - l1.x * l2.z, l1.x * l2.y - l1.y * l2.x };
+			for (int k = 0; k < 3; k++)
+			{
+				vec3f &v = vecSum[pIndices[i + k]];
+				v = { v.x + n.x, v.y + n.y, v.z + n.z };
+			}
+		}
+
+		for (auto &n : vecSum)
+		{
+			float l = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+			if (l > 0.0f)
+				n = { n.x / l, n.y / l, n.z / l };
+		}
+		vecVertNormals.swap(vecSum);
+		pVertNormals = vecVertNormals.data();
+	}
+
+	// Builds the BVH top down, splitting each node's triangles in half by
+	// centroid along the longest axis until they fit in a leaf, then reorders
+	// the triangles and vertices to match (see bvhNode). Works on our own
+	// vectors, so must be run before the mesh is saved to the cache.
+	void BuildBvh()
+	{
+		auto tStart = std::chrono::steady_clock::now();
+
+		vecBvh.clear();
+		const uint32_t nTris = nIndices / 3;
+		if (nTris == 0)
+		{
+			fBvhBuildMs = 0.0f;
+			return;
+		}
+
+		auto axis = [](const vec3f &v, int a) { return a == 0 ? v.x : a == 1 ? v.y : v.z; };
+
+		std::vector<vec3f> vecTriMin(nTris), vecTriMax(nTris), vecCentroid(nTris);
+		for (uint32_t t = 0; t < nTris; t++)
+		{
+			vec3f a = GetVertex(pIndices[t * 3 + 0]);
+			vec3f b = GetVertex(pIndices[t * 3 + 1]);
+			vec3f c = GetVertex(pIndices[t * 3 + 2]);
+			vecTriMin[t] = { min(a.x, min(b.x, c.x)), min(a.y, min(b.y, c.y)), min(a.z, min(b.z, c.z)) };
+			vecTriMax[t] = { max(a.x, max(b.x, c.x)), max(a.y, max(b.y, c.y)), max(a.z, max(b.z, c.z)) };
+			vecCentroid[t] = { (a.x + b.x + c.x) / 3.0f, (a.y + b.y + c.y) / 3.0f, (a.z + b.z + c.z) / 3.0f };
+		}
+
+		std::vector<uint32_t> vecOrder(nTris);
+		std::iota(vecOrder.begin(), vecOrder.end(), 0);
+
+		struct buildTask { uint32_t nNode, nFirst, nCount; };
+		std::vector<buildTask> vecTasks = { { 0, 0, nTris } };
+		vecBvh.reserve(2 * (nTris / nBvhLeafSize) + 1);
+		vecBvh.emplace_back();
+		while (!vecTasks.empty())
+		{
+			buildTask task = vecTasks.back();
+			vecTasks.pop_back();
+
+			vec3f vMin = vecTriMin[vecOrder[task.nFirst]], vMax = vecTriMax[vecOrder[task.nFirst]];
+			vec3f vCMin = vecCentroid[vecOrder[task.nFirst]], vCMax = vCMin;
+			for (uint32_t i = task.nFirst + 1; i < task.nFirst + task.nCount; i++)
+			{
+				uint32_t t = vecOrder[i];
+				vMin = { min(vMin.x, vecTriMin[t].x), min(vMin.y, vecTriMin[t].y), min(vMin.z, vecTriMin[t].z) };
+				vMax = { max(vMax.x, vecTriMax[t].x), max(vMax.y, vecTriMax[t].y), max(vMax.z, vecTriMax[t].z) };
+				vCMin = { min(vCMin.x, vecCentroid[t].x), min(vCMin.y, vecCentroid[t].y), min(vCMin.z, vecCentroid[t].z) };
+				vCMax = { max(vCMax.x, vecCentroid[t].x), max(vCMax.y, vecCentroid[t].y), max(vCMax.z, vecCentroid[t].z) };
+			}
+
+			bvhNode &node = vecBvh[task.nNode];
+			node.vMin = vMin;
+			node.vMax = vMax;
+			node.nLeft = 0;
+			node.nTriFirst = task.nFirst;
+			node.nTriCount = task.nCount;
+			if (task.nCount <= nBvhLeafSize)
+				continue;
+
+			vec3f vExtent = { vCMax.x - vCMin.x, vCMax.y - vCMin.y, vCMax.z - vCMin.z };
+			int nAxis = vExtent.x >= vExtent.y && vExtent.x >= vExtent.z ? 0 : vExtent.y >= vExtent.z ? 1 : 2;
+			if (axis(vExtent, nAxis) <= 0.0f)
+				continue; // every centroid in the same place, nothing to split on
+
+			uint32_t nHalf = task.nCount / 2;
+			std::nth_element(vecOrder.begin() + task.nFirst, vecOrder.begin() + task.nFirst + nHalf, vecOrder.begin() + task.nFirst + task.nCount,
+				[&](uint32_t a, uint32_t b) { return axis(vecCentroid[a], nAxis) < axis(vecCentroid[b], nAxis); });
+
+			uint32_t nLeft = (uint32_t)vecBvh.size();
+			node.nLeft = nLeft;
+			vecBvh.emplace_back();
+			vecBvh.emplace_back();
+			vecTasks.push_back({ nLeft + 1, task.nFirst + nHalf, task.nCount - nHalf });
+			vecTasks.push_back({ nLeft, task.nFirst, nHalf });
+		}
+
+		// Triangles in BVH order, then vertices in order of first use. Any
+		// vertex no triangle uses goes on the end.
+		std::vector<uint32_t> vecNewIndices(nIndices);
+		std::vector<vec3f> vecNewNormals(nTris);
+		for (uint32_t t = 0; t < nTris; t++)
+		{
+			for (int k = 0; k < 3; k++)
+				vecNewIndices[t * 3 + k] = pIndices[vecOrder[t] * 3 + k];
+			vecNewNormals[t] = pFaceNormals[vecOrder[t]];
+		}
+
+		std::vector<uint32_t> vecRemap(nVerts, UINT32_MAX);
+		uint32_t nNext = 0;
+		for (auto &i : vecNewIndices)
+		{
+			if (vecRemap[i] == UINT32_MAX)
+				vecRemap[i] = nNext++;
+			i = vecRemap[i];
+		}
+		for (auto &r : vecRemap)
+			if (r == UINT32_MAX)
+				r = nNext++;
+
+		std::vector<float> vecNewX(nVerts), vecNewY(nVerts), vecNewZ(nVerts);
+		for (uint32_t v = 0; v < nVerts; v++)
+		{
+			vecNewX[vecRemap[v]] = pVertX[v];
+			vecNewY[vecRemap[v]] = pVertY[v];
+			vecNewZ[vecRemap[v]] = pVertZ[v];
+		}
+
+		vecVertX.swap(vecNewX);
+		vecVertY.swap(vecNewY);
+		vecVertZ.swap(vecNewZ);
+		vecIndices.swap(vecNewIndices);
+		vecFaceNormals.swap(vecNewNormals);
+		pVertX = vecVertX.data();
+		pVertY = vecVertY.data();
+		pVertZ = vecVertZ.data();
+		pIndices = vecIndices.data();
+		pFaceNormals = vecFaceNormals.data();
+
+		// Vertex ranges, children before their parents
+		for (size_t n = vecBvh.size(); n-- > 0;)
+		{
+			bvhNode &node = vecBvh[n];
+			if (node.nLeft == 0)
+			{
+				const uint32_t *pFirst = pIndices + node.nTriFirst * 3;
+				auto range = std::minmax_element(pFirst, pFirst + node.nTriCount * 3);
+				node.nVertFirst = *range.first;
+				node.nVertEnd = *range.second + 1;
+			}
+			else
+			{
+				node.nVertFirst = min(vecBvh[node.nLeft].nVertFirst, vecBvh[node.nLeft + 1].nVertFirst);
+				node.nVertEnd = max(vecBvh[node.nLeft].nVertEnd, vecBvh[node.nLeft + 1].nVertEnd);
+			}
+		}
+
+		fBvhBuildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+	}
+
+	// Recomputes every box from the current vertex positions, children before
+	// parents. The tree keeps its shape, so this is much cheaper than a build,
+	// though the boxes get looser the further vertices move.
+	void RefitBvh()
+	{
+		for (size_t n = vecBvh.size(); n-- > 0;)
+		{
+			bvhNode &node = vecBvh[n];
+			if (node.nLeft == 0)
+			{
+				const uint32_t *pFirst = pIndices + node.nTriFirst * 3;
+				node.vMin = node.vMax = GetVertex(pFirst[0]);
+				for (uint32_t i = 1; i < node.nTriCount * 3; i++)
+				{
+					vec3f v = GetVertex(pFirst[i]);
+					node.vMin = { min(node.vMin.x, v.x), min(node.vMin.y, v.y), min(node.vMin.z, v.z) };
+					node.vMax = { max(node.vMax.x, v.x), max(node.vMax.y, v.y), max(node.vMax.z, v.z) };
+				}
+			}
+			else
+			{
+				const bvhNode &l = vecBvh[node.nLeft];
+				const bvhNode &r = vecBvh[node.nLeft + 1];
+				node.vMin = { min(l.vMin.x, r.vMin.x), min(l.vMin.y, r.vMin.y), min(l.vMin.z, r.vMin.z) };
+				node.vMax = { max(l.vMax.x, r.vMax.x), max(l.vMax.y, r.vMax.y), max(l.vMax.z, r.vMax.z) };
+			}
+		}
+	}
+
+	// Builds vecLods by quadric error edge collapse (Garland & Heckbert). Each
+	// vertex starts out with the planes of the triangles around it, plus a
+	// steep plane along any open edge so that holes keep their shape. Then the
+	// edge whose collapse adds least error is collapsed, over and over, to the
+	// point of least combined error, skipping any collapse that would fold a
+	// triangle over or pinch the surface together. Each time the triangle count
+	// halves, what is left is saved as the next level.
+	void BuildLods()
+	{
+		auto tStart = std::chrono::steady_clock::now();
+
+		vecLods.clear();
+		const uint32_t nTris = nIndices / 3;
+
+		struct point { double x, y, z; };
+		auto sub = [](const point &a, const point &b) { return point{ a.x - b.x, a.y - b.y, a.z - b.z }; };
+		auto dot = [](const point &a, const point &b) { return a.x * b.x + a.y * b.y + a.z * b.z; };
+		auto cross = [](const point &a, const point &b) { return point{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; };
+
+		std::vector<point> vecPos(nVerts);
+		for (uint32_t v = 0; v < nVerts; v++)
+			vecPos[v] = { pVertX[v], pVertY[v], pVertZ[v] };
+		std::vector<uint32_t> vecTri(pIndices, pIndices + nIndices);
+		std::vector<uint8_t> vecTriAlive(nTris, 1);
+		std::vector<uint8_t> vecVertAlive(nVerts, 1);
+		std::vector<uint32_t> vecVertStamp(nVerts, 0);	// bumped when a vertex moves, to spot stale collapses
+		std::vector<quadric> vecQuadric(nVerts);
+		std::vector<std::vector<uint32_t>> vecVertTris(nVerts);
+		uint32_t nTrisAlive = nTris;
+
+		auto triNormal = [&](uint32_t t)
+		{
+			const uint32_t *idx = &vecTri[t * 3];
+			return cross(sub(vecPos[idx[1]], vecPos[idx[0]]), sub(vecPos[idx[2]], vecPos[idx[0]]));
+		};
+
+		// Triangle planes, and how many triangles use each edge
+		auto edgeKey = [](uint32_t a, uint32_t b) { return a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a; };
+		std::unordered_map<uint64_t, uint32_t> mapEdgeUse;
+		mapEdgeUse.reserve(nIndices);
+		for (uint32_t t = 0; t < nTris; t++)
+		{
+			const uint32_t *idx = &vecTri[t * 3];
+			point n = triNormal(t);
+			double l = sqrt(dot(n, n));
+			for (int k = 0; k < 3; k++)
+			{
+				if (l > 0.0)
+					vecQuadric[idx[k]].AddPlane(n.x / l, n.y / l, n.z / l, -dot(n, vecPos[idx[0]]) / l, 1.0);
+				vecVertTris[idx[k]].push_back(t);
+				mapEdgeUse[edgeKey(idx[k], idx[(k + 1) % 3])]++;
+			}
+		}
+
+		// Open edges get a heavily weighted plane through them, at right angles
+		// to their triangle, so collapses slide along them rather than off them
+		const double fBoundaryWeight = 100.0;
+		const size_t nMaxValence = 32;
+		for (uint32_t t = 0; t < nTris; t++)
+		{
+			const uint32_t *idx = &vecTri[t * 3];
+			point n = triNormal(t);
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t a = idx[k], b = idx[(k + 1) % 3];
+				if (mapEdgeUse.find(edgeKey(a, b))->second != 1)
+					continue;
+				point p = cross(sub(vecPos[b], vecPos[a]), n);
+				double l = sqrt(dot(p, p));
+				if (l <= 0.0)
+					continue;
+				p = { p.x / l, p.y / l, p.z / l };
+				vecQuadric[a].AddPlane(p.x, p.y, p.z, -dot(p, vecPos[a]), fBoundaryWeight);
+				vecQuadric[b].AddPlane(p.x, p.y, p.z, -dot(p, vecPos[a]), fBoundaryWeight);
+			}
+		}
+
+		// Candidate collapses of v1 into v0, cheapest first. Moving a vertex
+		// makes the ones already queued for it stale; they are skipped when
+		// they come up rather than searched for.
+		struct collapse
+		{
+			double fCost;
+			point p;
+			uint32_t v0, v1;
+			uint32_t nStamp0, nStamp1;
+		};
+		auto evaluate = [&](uint32_t v0, uint32_t v1)
+		{
+			quadric q = vecQuadric[v0];
+			q.Add(vecQuadric[v1]);
+
+			// Best of the two ends, the midpoint and the optimum, if the optimum
+			// is anywhere near the edge
+			const point &a = vecPos[v0], &b = vecPos[v1];
+			point mid = { (a.x + b.x) * 0.5, (a.y + b.y) * 0.5, (a.z + b.z) * 0.5 };
+			point candidates[4] = { a, b, mid };
+			int nCandidates = 3;
+			point opt;
+			if (q.Minimum(opt.x, opt.y, opt.z) && dot(sub(opt, mid), sub(opt, mid)) <= dot(sub(b, a), sub(b, a)))
+				candidates[nCandidates++] = opt;
+
+			collapse c = { q.Error(a.x, a.y, a.z), a, v0, v1, vecVertStamp[v0], vecVertStamp[v1] };
+			for (int i = 1; i < nCandidates; i++)
+			{
+				double fCost = q.Error(candidates[i].x, candidates[i].y, candidates[i].z);
+				if (fCost < c.fCost)
+				{
+					c.fCost = fCost;
+					c.p = candidates[i];
+				}
+			}
+			return c;
+		};
+		auto cheaper = [](const collapse &a, const collapse &b) { return a.fCost > b.fCost; };
+
+		std::vector<collapse> vecHeap;
+		vecHeap.reserve(mapEdgeUse.size());
+		for (auto &e : mapEdgeUse)
+			if ((uint32_t)(e.first >> 32) != (uint32_t)e.first)
+				vecHeap.push_back(evaluate((uint32_t)(e.first >> 32), (uint32_t)e.first));
+		std::make_heap(vecHeap.begin(), vecHeap.end(), cheaper);
+
+		// Vertices sharing a live triangle with v. Also drops v's dead triangles.
+		auto neighbours = [&](uint32_t v, std::vector<uint32_t> &vecOut)
+		{
+			std::vector<uint32_t> &vecTris = vecVertTris[v];
+			vecTris.erase(std::remove_if(vecTris.begin(), vecTris.end(), [&](uint32_t t) { return !vecTriAlive[t]; }), vecTris.end());
+			vecOut.clear();
+			for (uint32_t t : vecTris)
+				for (int k = 0; k < 3; k++)
+					if (vecTri[t * 3 + k] != v)
+						vecOut.push_back(vecTri[t * 3 + k]);
+			std::sort(vecOut.begin(), vecOut.end());
+			vecOut.erase(std::unique(vecOut.begin(), vecOut.end()), vecOut.end());
+		};
+
+		// Whether moving v to p turns any triangle it keeps (one without vOther)
+		// over or edge on. Ones that were already edge on are let be.
+		auto folds = [&](uint32_t v, uint32_t vOther, const point &p)
+		{
+			for (uint32_t t : vecVertTris[v])
+			{
+				const uint32_t *idx = &vecTri[t * 3];
+				if (!vecTriAlive[t] || idx[0] == vOther || idx[1] == vOther || idx[2] == vOther)
+					continue;
+				point before = triNormal(t);
+				point pts[3] = { vecPos[idx[0]], vecPos[idx[1]], vecPos[idx[2]] };
+				for (int k = 0; k < 3; k++)
+					if (idx[k] == v)
+						pts[k] = p;
+				point after = cross(sub(pts[1], pts[0]), sub(pts[2], pts[0]));
+				double fBefore = dot(before, before);
+				if (fBefore > 0.0 && dot(before, after) <= 0.2 * sqrt(fBefore * dot(after, after)))
+					return true;
+			}
+			return false;
+		};
+
+		// A level whose error is as big as the mesh itself would only ever be
+		// picked for something smaller on screen than the error allowed, so stop
+		// short of that
+		vec3f vCentre;
+		float fRadius;
+		BoundingSphere(vCentre, fRadius);
+		const double fCostLimit = (double)fRadius * fRadius;
+
+		std::vector<uint32_t> vecRing0, vecRing1, vecCommon;
+		std::vector<uint32_t> vecRemap(nVerts);
+		double fMaxCost = 0.0;
+		uint32_t nTarget = nTris / 2;
+		while (vecLods.size() < nMaxLods && nTarget >= nLodMinTriangles)
+		{
+			while (nTrisAlive > nTarget && !vecHeap.empty())
+			{
+				std::pop_heap(vecHeap.begin(), vecHeap.end(), cheaper);
+				collapse c = vecHeap.back();
+				vecHeap.pop_back();
+				if (c.fCost > fCostLimit)
+				{
+					vecHeap.clear();
+					break;
+				}
+				if (!vecVertAlive[c.v0] || !vecVertAlive[c.v1] || vecVertStamp[c.v0] != c.nStamp0 || vecVertStamp[c.v1] != c.nStamp1)
+					continue;
+
+				// Link condition: the ends may only have in common the vertices
+				// opposite the edge, or the collapse glues two sheets together.
+				// Collapses that would make a vertex with a great many neighbours
+				// are skipped too; they are ugly, and slow everything after them.
+				uint32_t nShared = 0;
+				for (uint32_t t : vecVertTris[c.v0])
+					if (vecTriAlive[t] && (vecTri[t * 3] == c.v1 || vecTri[t * 3 + 1] == c.v1 || vecTri[t * 3 + 2] == c.v1))
+						nShared++;
+				neighbours(c.v0, vecRing0);
+				neighbours(c.v1, vecRing1);
+				if (vecRing0.size() + vecRing1.size() > nMaxValence)
+					continue;
+				vecCommon.clear();
+				std::set_intersection(vecRing0.begin(), vecRing0.end(), vecRing1.begin(), vecRing1.end(), std::back_inserter(vecCommon));
+				if (vecCommon.size() != nShared || folds(c.v0, c.v1, c.p) || folds(c.v1, c.v0, c.p))
+					continue;
+
+				// Collapse: v1's triangles move to v0, those on the edge vanish
+				vecPos[c.v0] = c.p;
+				vecQuadric[c.v0].Add(vecQuadric[c.v1]);
+				vecVertAlive[c.v1] = 0;
+				vecVertStamp[c.v0]++;
+				std::vector<uint32_t> &vecTris0 = vecVertTris[c.v0];
+				for (uint32_t t : vecVertTris[c.v1])
+				{
+					uint32_t *idx = &vecTri[t * 3];
+					if (!vecTriAlive[t])
+						continue;
+					if (idx[0] == c.v0 || idx[1] == c.v0 || idx[2] == c.v0)
+					{
+						vecTriAlive[t] = 0;
+						nTrisAlive--;
+						continue;
+					}
+					for (int k = 0; k < 3; k++)
+						if (idx[k] == c.v1)
+							idx[k] = c.v0;
+					vecTris0.push_back(t);
+				}
+				std::vector<uint32_t>().swap(vecVertTris[c.v1]);
+				fMaxCost = max(fMaxCost, c.fCost);
+
+				neighbours(c.v0, vecRing0);
+				for (uint32_t n : vecRing0)
+				{
+					vecHeap.push_back(evaluate(c.v0, n));
+					std::push_heap(vecHeap.begin(), vecHeap.end(), cheaper);
+				}
+			}
+
+			// Out of collapses that are allowed. Only keep what is left if it is
+			// a real saving on the level before.
+			uint32_t nPrevious = vecLods.empty() ? nTris : vecLods.back().nIndices / 3;
+			if ((uint64_t)nTrisAlive * 4 > (uint64_t)nPrevious * 3)
+				break;
+
+			mesh lod;
+			std::fill(vecRemap.begin(), vecRemap.end(), UINT32_MAX);
+			lod.vecIndices.reserve(nTrisAlive * 3);
+			for (uint32_t t = 0; t < nTris; t++)
+			{
+				if (!vecTriAlive[t])
+					continue;
+				for (int k = 0; k < 3; k++)
+				{
+					uint32_t v = vecTri[t * 3 + k];
+					if (vecRemap[v] == UINT32_MAX)
+					{
+						vecRemap[v] = (uint32_t)lod.vecVertX.size();
+						lod.vecVertX.push_back((float)vecPos[v].x);
+						lod.vecVertY.push_back((float)vecPos[v].y);
+						lod.vecVertZ.push_back((float)vecPos[v].z);
+					}
+					lod.vecIndices.push_back(vecRemap[v]);
+				}
+			}
+			lod.pVertX = lod.vecVertX.data();
+			lod.pVertY = lod.vecVertY.data();
+			lod.pVertZ = lod.vecVertZ.data();
+			lod.pIndices = lod.vecIndices.data();
+			lod.nVerts = (uint32_t)lod.vecVertX.size();
+			lod.nIndices = (uint32_t)lod.vecIndices.size();
+			lod.ComputeFaceNormalsAndBounds();
+			lod.BuildBvh();
+			lod.ComputeVertexNormals();
+
+			// The cost is a sum of squared distances to planes, so its root is
+			// no less than the distance to any one of them
+			lod.fLodError = (float)sqrt(fMaxCost);
+			vecLods.push_back(std::move(lod));
+			nTarget = nTrisAlive / 2;
+		}
+
+		fLodBuildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+	}
+
+	bool SaveToCacheFile(const std::string &sCacheFile)
+	{
+		struct section { uint32_t nId; const void *pData; uint64_t nBytes; };
+		std::vector<section> sections;
+		auto addLevel = [&](const mesh &m, uint32_t nLevel)
+		{
+			uint32_t nTag = nLevel << MESH_SECTION_LEVEL_SHIFT;
+			sections.push_back({ MESH_SECTION_VERTEX_X | nTag, m.pVertX, sizeof(float) * (uint64_t)m.nVerts });
+			sections.push_back({ MESH_SECTION_VERTEX_Y | nTag, m.pVertY, sizeof(float) * (uint64_t)m.nVerts });
+			sections.push_back({ MESH_SECTION_VERTEX_Z | nTag, m.pVertZ, sizeof(float) * (uint64_t)m.nVerts });
+			sections.push_back({ MESH_SECTION_INDICES | nTag, m.pIndices, sizeof(uint32_t) * (uint64_t)m.nIndices });
+			sections.push_back({ MESH_SECTION_FACE_NORMALS | nTag, m.pFaceNormals, sizeof(vec3f) * (uint64_t)(m.nIndices / 3) });
+			sections.push_back({ MESH_SECTION_VERTEX_NORMALS | nTag, m.pVertNormals, sizeof(vec3f) * (uint64_t)m.nVerts });
+			sections.push_back({ MESH_SECTION_BVH_NODES | nTag, m.vecBvh.data(), sizeof(bvhNode) * (uint64_t)m.vecBvh.size() });
+		};
+
+		addLevel(*this, 0);
+		std::vector<meshCacheLevel> vecLevels;
+		for (uint32_t i = 0; i < (uint32_t)vecLods.size(); i++)
+		{
+			const mesh &lod = vecLods[i];
+			vecLevels.push_back({ lod.nVerts, lod.nIndices, (uint32_t)lod.vecBvh.size(), lod.fLodError, lod.vBoundsMin, lod.vBoundsMax });
+			addLevel(lod, i + 1);
+		}
+		if (!vecLevels.empty())
+			sections.push_back({ MESH_SECTION_LODS, vecLevels.data(), sizeof(meshCacheLevel) * (uint64_t)vecLevels.size() });
+		const uint32_t nSections = (uint32_t)sections.size();
+
+		auto align = [](uint64_t n) { return (n + 15) & ~(uint64_t)15; };
+
+		meshCacheHeader header;
+		memcpy(header.magic, "CE3M", 4);
+		header.nVersion = MESH_CACHE_VERSION;
+		header.nSections = nSections;
+		header.nVerts = nVerts;
+		header.nIndices = nIndices;
+		header.vBoundsMin = vBoundsMin;
+		header.vBoundsMax = vBoundsMax;
+		header.nBvhNodes = (uint32_t)vecBvh.size();
+		header.nLods = (uint32_t)vecLods.size();
+		memset(header.nReserved, 0, sizeof(header.nReserved));
+
+		std::vector<meshCacheSection> table(nSections);
+		uint64_t nOffset = align(sizeof(header) + sizeof(meshCacheSection) * (uint64_t)nSections);
+		for (uint32_t i = 0; i < nSections; i++)
+		{
+			table[i] = { sections[i].nId, 0, nOffset, sections[i].nBytes };
+			nOffset = align(nOffset + sections[i].nBytes);
+		}
+
+		// Write to a temporary and swap it in, so a crash never leaves a
+		// half-written cache that looks newer than the .obj
+		std::string sTempFile = sCacheFile + ".tmp";
+		bool bWritten = false;
+		{
+			std::ofstream f(sTempFile, std::ios::binary | std::ios::trunc);
+			if (!f.is_open())
+				return false;
+
+			f.write((const char*)&header, sizeof(header));
+			f.write((const char*)table.data(), sizeof(meshCacheSection) * (uint64_t)nSections);
+			for (uint32_t i = 0; i < nSections; i++)
+			{
+				f.seekp(table[i].nOffset);
+				f.write((const char*)sections[i].pData, sections[i].nBytes);
+			}
+			// Pad the tail so every section, including the last, is whole
+			const char pad[16] = { 0 };
+			f.write(pad, align(f.tellp()) - (uint64_t)f.tellp());
+			f.close();
+			bWritten = !f.fail();
+		}
+
+		std::error_code ec;
+		if (bWritten)
+			std::filesystem::rename(sTempFile, sCacheFile, ec);
+		if (!bWritten || ec)
+		{
+			std::filesystem::remove(sTempFile, ec);
+			return false;
+		}
+		return true;
+	}
+
+	bool LoadFromCacheFile(const std::string &sCacheFile)
+	{
+		auto mapping = std::make_shared<mappedFile>();
+		if (!mapping->Open(sCacheFile) || mapping->Size() < sizeof(meshCacheHeader))
+			return false;
+
+		const meshCacheHeader *header = (const meshCacheHeader*)mapping->Data();
+		if (memcmp(header->magic, "CE3M", 4) != 0 || header->nVersion != MESH_CACHE_VERSION)
+			return false;
+		if (sizeof(meshCacheHeader) + (uint64_t)header->nSections * sizeof(meshCacheSection) > mapping->Size())
+			return false;
+
+		// Locate each section, checking it lies inside the file and is the size
+		// the header says it should be
+		auto find = [&](uint32_t nId, uint64_t nExpectedBytes) -> const void*
+		{
+			const meshCacheSection *table = (const meshCacheSection*)(header + 1);
+			for (uint32_t i = 0; i < header->nSections; i++)
+			{
+				if (table[i].nId != nId)
+					continue;
+				if (table[i].nBytes != nExpectedBytes || table[i].nOffset > mapping->Size() ||
+					table[i].nBytes > mapping->Size() - table[i].nOffset)
+					return nullptr;
+				return mapping->Data() + table[i].nOffset;
+			}
+			return nullptr;
+		};
+
+		meshCacheLevel full = { header->nVerts, header->nIndices, header->nBvhNodes, 0.0f, header->vBoundsMin, header->vBoundsMax };
+		const meshCacheLevel *levels = (const meshCacheLevel*)find(MESH_SECTION_LODS, sizeof(meshCacheLevel) * (uint64_t)header->nLods);
+		if (header->nLods > nMaxLods || (header->nLods > 0 && levels == nullptr))
+			return false;
+
+		std::vector<mesh> vecCachedLods(header->nLods);
+		for (uint32_t i = 0; i < header->nLods; i++)
+			if (!vecCachedLods[i].AttachCacheLevel(find, i + 1, levels[i]))
+				return false;
+		if (!AttachCacheLevel(find, 0, full))
+			return false;
+
+		vecVerts.clear();
+		vecLods.swap(vecCachedLods);
+		fLodBuildMs = -1.0f;
+		cacheMapping = mapping;
+		return true;
+	}
+
+	// Points the geometry at one level's sections of a mapped cache file
+	template<typename F>
+	bool AttachCacheLevel(const F &find, uint32_t nLevel, const meshCacheLevel &level)
+	{
+		uint32_t nTag = nLevel << MESH_SECTION_LEVEL_SHIFT;
+		const void *vertX = find(MESH_SECTION_VERTEX_X | nTag, sizeof(float) * (uint64_t)level.nVerts);
+		const void *vertY = find(MESH_SECTION_VERTEX_Y | nTag, sizeof(float) * (uint64_t)level.nVerts);
+		const void *vertZ = find(MESH_SECTION_VERTEX_Z | nTag, sizeof(float) * (uint64_t)level.nVerts);
+		const void *indices = find(MESH_SECTION_INDICES | nTag, sizeof(uint32_t) * (uint64_t)level.nIndices);
+		const void *normals = find(MESH_SECTION_FACE_NORMALS | nTag, sizeof(vec3f) * (uint64_t)(level.nIndices / 3));
+		const void *bvh = find(MESH_SECTION_BVH_NODES | nTag, sizeof(bvhNode) * (uint64_t)level.nBvhNodes);
+		const void *vertNormals = find(MESH_SECTION_VERTEX_NORMALS | nTag, sizeof(vec3f) * (uint64_t)level.nVerts);
+		if (((vertX == nullptr || vertY == nullptr || vertZ == nullptr || vertNormals == nullptr) && level.nVerts > 0) || (indices == nullptr && level.nIndices > 0) ||
+			((normals == nullptr || bvh == nullptr || level.nBvhNodes == 0) && level.nIndices >= 3))
+			return false;
+		if (!ValidateCacheLevel(level, (const uint32_t*)indices, (const bvhNode*)bvh))
+			return false;
+
+		vecVertX.clear();
+		vecVertY.clear();
+		vecVertZ.clear();
+		vecIndices.clear();
+		vecFaceNormals.clear();
+		vecVertNormals.clear();
+		pVertX = (const float*)vertX;
+		pVertY = (const float*)vertY;
+		pVertZ = (const float*)vertZ;
+		pIndices = (const uint32_t*)indices;
+		pFaceNormals = (const vec3f*)normals;
+		pVertNormals = (const vec3f*)vertNormals;
+		nVerts = level.nVerts;
+		nIndices = level.nIndices;
+		vBoundsMin = level.vBoundsMin;
+		vBoundsMax = level.vBoundsMax;
+		vecBvh.assign((const bvhNode*)bvh, (const bvhNode*)bvh + level.nBvhNodes);
+		fBvhBuildMs = -1.0f;
+		fLodError = level.fLodError;
+		return true;
+	}
+
+	// The renderer trusts indices and BVH nodes without checking them, so a
+	// cache file is checked once here instead: every index names a vertex,
+	// every node's ranges lie inside the mesh, and children come after their
+	// parent, which rules out cycles and bounds the depth for CullBvh.
+	static bool ValidateCacheLevel(const meshCacheLevel &level, const uint32_t *pIdx, const bvhNode *pNodes)
+	{
+		if (level.nIndices % 3 != 0)
+			return false;
+		for (uint32_t i = 0; i < level.nIndices; i++)
+			if (pIdx[i] >= level.nVerts)
+				return false;
+
+		uint32_t nTris = level.nIndices / 3;
+		std::vector<uint8_t> vecDepth(level.nBvhNodes, 0);
+		for (uint32_t i = 0; i < level.nBvhNodes; i++)
+		{
+			const bvhNode &node = pNodes[i];
+			if (node.nTriFirst > nTris || node.nTriCount > nTris - node.nTriFirst ||
+				node.nVertFirst > node.nVertEnd || node.nVertEnd > level.nVerts)
+				return false;
+			if (node.nLeft == 0)
+				continue;
+			if (node.nLeft <= i || node.nLeft >= level.nBvhNodes - 1 || vecDepth[i] >= nMaxBvhDepth)
+				return false;
+			vecDepth[node.nLeft] = max(vecDepth[node.nLeft], (uint8_t)(vecDepth[i] + 1));
+			vecDepth[node.nLeft + 1] = max(vecDepth[node.nLeft + 1], (uint8_t)(vecDepth[i] + 1));
+		}
+		return true;
+	}
+
+	// Memory the geometry takes up, wherever it lives, LOD levels included
+	size_t GeometryBytes() const
+	{
+		size_t nBytes = (sizeof(float) * 3 + sizeof(vec3f)) * (size_t)nVerts + sizeof(uint32_t) * (size_t)nIndices +
+			sizeof(vec3f) * (size_t)(nIndices / 3) + sizeof(bvhNode) * vecBvh.size();
+		for (auto &lod : vecLods)
+			nBytes += lod.GeometryBytes();
+		return nBytes;
+	}
+
+	// Level n of detail, 0 being the full mesh
+	const mesh &GetLod(uint32_t n) const
+	{
+		return n == 0 ? *this : vecLods[n - 1];
+	}
+
+	uint32_t LodCount() const
+	{
+		return 1 + (uint32_t)vecLods.size();
+	}
+
+	// Bounding sphere around the bounding box
+	void BoundingSphere(vec3f &vCentre, float &fRadius) const
+	{
+		vCentre = { (vBoundsMin.x + vBoundsMax.x) * 0.5f, (vBoundsMin.y + vBoundsMax.y) * 0.5f, (vBoundsMin.z + vBoundsMax.z) * 0.5f };
+		vec3f e = { vBoundsMax.x - vCentre.x, vBoundsMax.y - vCentre.y, vBoundsMax.z - vCentre.z };
+		fRadius = sqrtf(e.x * e.x + e.y * e.y + e.z * e.z);
+	}
+
+	vec3f GetVertex(uint32_t i) const
+	{
+		return { pVertX[i], pVertY[i], pVertZ[i] };
+	}
+
+	// Exporters often write a separate copy of a vertex for every face using it
+	// (one per UV or normal seam), which defeats transforming each vertex once.
+	// Merge vertices with bit-identical positions and remap the indices, leaving
+	// the result in the x/y/z arrays.
+	void WeldVertices()
+	{
+		struct key
+		{
+			uint32_t x, y, z;
+			bool operator==(const key &k) const { return x == k.x && y == k.y && z == k.z; }
+		};
+		struct keyHash
+		{
+			size_t operator()(const key &k) const { return (size_t)(k.x * 73856093u ^ k.y * 19349663u ^ k.z * 83492791u); }
+		};
+
+		auto bits = [](float f)
+		{
+			if (f == 0.0f) f = 0.0f; // -0 and +0 are the same place
+			uint32_t n;
+			memcpy(&n, &f, sizeof(n));
+			return n;
+		};
+
+		std::unordered_map<key, uint32_t, keyHash> mapUnique;
+		mapUnique.reserve(vecVerts.size());
+		std::vector<uint32_t> vecRemap(vecVerts.size());
+		vecVertX.clear();
+		vecVertY.clear();
+		vecVertZ.clear();
+
+		for (size_t i = 0; i < vecVerts.size(); i++)
+		{
+			const vec3f &v = vecVerts[i];
+			auto r = mapUnique.emplace(key{ bits(v.x), bits(v.y), bits(v.z) }, (uint32_t)vecVertX.size());
+			if (r.second)
+			{
+				vecVertX.push_back(v.x);
+				vecVertY.push_back(v.y);
+				vecVertZ.push_back(v.z);
+			}
+			vecRemap[i] = r.first->second;
+		}
+
+		for (auto &i : vecIndices)
+			i = vecRemap[i];
+
+		std::vector<vec3f>().swap(vecVerts);
+		pVertX = vecVertX.data();
+		pVertY = vecVertY.data();
+		pVertZ = vecVertZ.data();
+		nVerts = (uint32_t)vecVertX.size();
+	}
+};
+
+struct mat4x4
+{
+	float m[4][4] = { 0 };
+};
+
+// Index of a mesh in a scene
+typedef uint32_t meshHandle;
+
+// A scene is a set of meshes and a set of instances of them. Each instance is
+// just a mesh handle and a world matrix - the geometry itself is shared - so a
+// hundred copies of a model cost one copy of its mesh and 68 bytes apiece.
+// Instances are kept as parallel arrays, and the world matrices in particular
+// sit back to back for the vertex stage to walk through in order. World
+// matrices must be rotation and translation only.
+struct scene
+{
+	std::vector<mesh> vecMeshes;
+	std::vector<mat4x4> vecInstanceWorld;
+	std::vector<meshHandle> vecInstanceMesh;
+
+	// Even if loading fails the handle is good, it just refers to an empty mesh
+	meshHandle LoadMesh(const std::string &sFile)
+	{
+		vecMeshes.emplace_back();
+		vecMeshes.back().LoadFromObjFile(sFile);
+		return (meshHandle)(vecMeshes.size() - 1);
+	}
+
+	uint32_t AddInstance(meshHandle hMesh, const mat4x4 &matWorld)
+	{
+		vecInstanceWorld.push_back(matWorld);
+		vecInstanceMesh.push_back(hMesh);
+		return (uint32_t)(vecInstanceWorld.size() - 1);
+	}
+
+	// Keeps the first nCount instances
+	void TruncateInstances(uint32_t nCount)
+	{
+		vecInstanceWorld.resize(min((size_t)nCount, vecInstanceWorld.size()));
+		vecInstanceMesh.resize(vecInstanceWorld.size());
+	}
+
+	uint32_t InstanceCount() const
+	{
+		return (uint32_t)vecInstanceWorld.size();
+	}
+};
+
+// Batch point transform ======================================================
+//
+// TransformPoints() takes n points as separate x/y/z arrays, treats each as
+// (x, y, z, 1) and writes the transformed x/y/z/w arrays. The outputs may be the
+// same arrays as the inputs. There is one kernel per instruction set, picked at
+// runtime for the CPU we are on. Each does exactly the multiplies and adds of
+// MatrixMultiplyVector, in the same order and without fused multiply-add, so
+// they all give bit-identical results and the choice only affects speed.
+
+typedef void(*transformPointsFn)(const mat4x4 &m, const float *x, const float *y, const float *z,
+	float *ox, float *oy, float *oz, float *ow, size_t n);
+
+static void TransformPointsScalar(const mat4x4 &m, const float *x, const float *y, const float *z,
+	float *ox, float *oy, float *oz, float *ow, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		float px = x[i], py = y[i], pz = z[i];
+		ox[i] = px * m.m[0][0] + py * m.m[1][0] + pz * m.m[2][0] + m.m[3][0];
+		oy[i] = px * m.m[0][1] + py * m.m[1][1] + pz * m.m[2][1] + m.m[3][1];
+		oz[i] = px * m.m[0][2] + py * m.m[1][2] + pz * m.m[2][2] + m.m[3][2];
+		ow[i] = px * m.m[0][3] + py * m.m[1][3] + pz * m.m[2][3] + m.m[3][3];
+	}
+}
+
+#ifdef CE3D_X86
+CE3D_TARGET("sse2") static void TransformPointsSSE2(const mat4x4 &m, const float *x, const float *y, const float *z,
+	float *ox, float *oy, float *oz, float *ow, size_t n)
+{
+	__m128 c[4][4];
+	for (int r = 0; r < 4; r++)
+		for (int k = 0; k < 4; k++)
+			c[r][k] = _mm_set1_ps(m.m[r][k]);
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 px = _mm_loadu_ps(x + i);
+		__m128 py = _mm_loadu_ps(y + i);
+		__m128 pz = _mm_loadu_ps(z + i);
+		_mm_storeu_ps(ox + i, _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, c[0][0]), _mm_mul_ps(py, c[1][0])), _mm_mul_ps(pz, c[2][0])), c[3][0]));
+		_mm_storeu_ps(oy + i, _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, c[0][1]), _mm_mul_ps(py, c[1][1])), _mm_mul_ps(pz, c[2][1])), c[3][1]));
+		_mm_storeu_ps(oz + i, _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, c[0][2]), _mm_mul_ps(py, c[1][2])), _mm_mul_ps(pz, c[2][2])), c[3][2]));
+		_mm_storeu_ps(ow + i, _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, c[0][3]), _mm_mul_ps(py, c[1][3])), _mm_mul_ps(pz, c[2][3])), c[3][3]));
+	}
+	TransformPointsScalar(m, x + i, y + i, z + i, ox + i, oy + i, oz + i, ow + i, n - i);
+}
+
+CE3D_TARGET("avx2") static void TransformPointsAVX2(const mat4x4 &m, const float *x, const float *y, const float *z,
+	float *ox, float *oy, float *oz, float *ow, size_t n)
+{
+	__m256 c[4][4];
+	for (int r = 0; r < 4; r++)
+		for (int k = 0; k < 4; k++)
+			c[r][k] = _mm256_set1_ps(m.m[r][k]);
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 px = _mm256_loadu_ps(x + i);
+		__m256 py = _mm256_loadu_ps(y + i);
+		__m256 pz = _mm256_loadu_ps(z + i);
+		_mm256_storeu_ps(ox + i, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, c[0][0]), _mm256_mul_ps(py, c[1][0])), _mm256_mul_ps(pz, c[2][0])), c[3][0]));
+		_mm256_storeu_ps(oy + i, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, c[0][1]), _mm256_mul_ps(py, c[1][1])), _mm256_mul_ps(pz, c[2][1])), c[3][1]));
+		_mm256_storeu_ps(oz + i, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, c[0][2]), _mm256_mul_ps(py, c[1][2])), _mm256_mul_ps(pz, c[2][2])), c[3][2]));
+		_mm256_storeu_ps(ow + i, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, c[0][3]), _mm256_mul_ps(py, c[1][3])), _mm256_mul_ps(pz, c[2][3])), c[3][3]));
+	}
+	TransformPointsSSE2(m, x + i, y + i, z + i, ox + i, oy + i, oz + i, ow + i, n - i);
+}
+
+static bool CpuHasSSE2()
+{
+#ifdef _MSC_VER
+	int r[4];
+	__cpuid(r, 1);
+	return (r[3] & (1 << 26)) != 0;
+#else
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static bool CpuHasAVX2()
+{
+#ifdef _MSC_VER
+	int r[4];
+	__cpuid(r, 0);
+	if (r[0] < 7)
+		return false;
+
+	// The OS must also be saving the YMM registers on context switches
+	__cpuid(r, 1);
+	bool bOSXSave = (r[2] & (1 << 27)) != 0;
+	bool bAVX = (r[2] & (1 << 28)) != 0;
+	if (!bOSXSave || !bAVX || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(r, 7, 0);
+	return (r[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+static transformPointsFn SelectTransformPoints()
+{
+#ifdef CE3D_X86
+	if (CpuHasAVX2())
+		return TransformPointsAVX2;
+	if (CpuHasSSE2())
+		return TransformPointsSSE2;
+#endif
+	return TransformPointsScalar;
+}
+
+inline void TransformPoints(const mat4x4 &m, const float *x, const float *y, const float *z,
+	float *ox, float *oy, float *oz, float *ow, size_t n)
+{
+	static const transformPointsFn fnKernel = SelectTransformPoints();
+	fnKernel(m, x, y, z, ox, oy, oz, ow, n);
+}
+
+// Output of TransformPoints for a whole mesh, as separate x/y/z/w arrays
+struct vertexStream
+{
+	std::vector<float> x, y, z, w;
+
+	void Resize(size_t n)
+	{
+		x.resize(n);
+		y.resize(n);
+		z.resize(n);
+		w.resize(n);
+	}
+
+	void Reserve(size_t n)
+	{
+		x.reserve(n);
+		y.reserve(n);
+		z.reserve(n);
+		w.reserve(n);
+	}
+
+	vec3d Get(uint32_t i) const
+	{
+		return { x[i], y[i], z[i], w[i] };
+	}
+};
+
+// Small persistent thread pool. Run(n, job) calls job(i) for every i in [0, n),
+// shared between the workers and the calling thread, and returns once all of
+// them have finished. Jobs are handed out one at a time, so uneven jobs still
+// balance out. job is only borrowed for the call, nothing is allocated.
+class workerPool
+{
+public:
+	explicit workerPool(unsigned nWorkers)
+	{
+		for (unsigned i = 0; i < nWorkers; i++)
+			vecWorkers.emplace_back(&workerPool::WorkerThread, this);
+	}
+
+	~workerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(muxWork);
+			bQuit = true;
+		}
+		cvWork.notify_all();
+		for (auto &t : vecWorkers)
+			t.join();
+	}
+
+	workerPool(const workerPool&) = delete;
+	workerPool &operator=(const workerPool&) = delete;
+
+	unsigned Threads() const
+	{
+		return (unsigned)vecWorkers.size() + 1;
+	}
+
+	template<typename F>
+	void Run(uint32_t n, F &&job)
+	{
+		if (n == 0)
+			return;
+
+		batch b;
+		{
+			std::lock_guard<std::mutex> lock(muxWork);
+			pJob = &job;
+			fnInvoke = [](void *p, uint32_t i) { (*static_cast<std::remove_reference_t<F>*>(p))(i); };
+			nJobs = n;
+			nDone = 0;
+			nGeneration++;
+			nNext = (uint64_t)(uint32_t)nGeneration << 32;
+			b = CurrentBatch();
+		}
+		cvWork.notify_all();
+
+		DoJobs(b);
+
+		std::unique_lock<std::mutex> lock(muxWork);
+		cvDone.wait(lock, [&] { return nDone == nJobs; });
+	}
+
+private:
+	// One Run()'s work, copied under the lock, so a worker that wakes late
+	// never mixes up one batch with the next
+	struct batch
+	{
+		uint32_t nGeneration;
+		uint32_t nJobs;
+		void *pJob;
+		void (*fnInvoke)(void*, uint32_t);
+	};
+
+	batch CurrentBatch() const
+	{
+		return { (uint32_t)nGeneration, nJobs, pJob, fnInvoke };
+	}
+
+	void WorkerThread()
+	{
+		OLC_TRACE_THREAD("Worker");
+		uint64_t nSeen = 0;
+		for (;;)
+		{
+			batch b;
+			{
+				std::unique_lock<std::mutex> lock(muxWork);
+				cvWork.wait(lock, [&] { return bQuit || nGeneration != nSeen; });
+				if (bQuit)
+					return;
+				nSeen = nGeneration;
+				b = CurrentBatch();
+			}
+			DoJobs(b);
+		}
+	}
+
+	// nNext holds the generation in its top half and the next job in the
+	// bottom, so a job is only claimed while its own batch is still current
+	void DoJobs(const batch &b)
+	{
+		for (;;)
+		{
+			uint64_t nClaim = nNext.load();
+			do
+			{
+				if ((uint32_t)(nClaim >> 32) != b.nGeneration || (uint32_t)nClaim >= b.nJobs)
+					return;
+			} while (!nNext.compare_exchange_weak(nClaim, nClaim + 1));
+
+			b.fnInvoke(b.pJob, (uint32_t)nClaim);
+			if (++nDone == b.nJobs)
+			{
+				std::lock_guard<std::mutex> lock(muxWork);
+				cvDone.notify_all();
+			}
+		}
+	}
+
+	std::vector<std::thread> vecWorkers;
+	std::mutex muxWork;
+	std::condition_variable cvWork;
+	std::condition_variable cvDone;
+	void *pJob = nullptr;
+	void (*fnInvoke)(void*, uint32_t) = nullptr;
+	uint32_t nJobs = 0;
+	std::atomic<uint64_t> nNext{ 0 };
+	std::atomic<uint32_t> nDone{ 0 };
+	uint64_t nGeneration = 0;
+	bool bQuit = false;
+};
+
+// Orders triangles by a 24-bit depth key, smallest first. Keys are sorted as
+// (key, index) pairs packed into 64 bits, so ties always keep submission order
+// and the result is fully determined by the keys.
+//
+// Radix mode is an LSD radix sort, one pass per key byte, skipping any byte
+// every key has the same. Temporal mode starts from the previous call's order
+// instead and repairs it with insertion sort, which is close to linear when
+// little has moved since. If the repair runs over budget it gives up and falls
+// back to the radix sort. Both give exactly the same order. Nothing is
+// allocated once the buffers have grown to fit.
+class depthSorter
+{
+public:
+	enum sortMode { SORT_RADIX, SORT_TEMPORAL };
+
+	static constexpr uint32_t nKeyBits = 24;
+
+	// Returns the order of the n keys. bTemporal asks for the previous order to
+	// be reused, which only happens if it was for the same number of keys.
+	const std::vector<uint32_t> &Sort(const uint32_t *pKeys, uint32_t n, bool bTemporal)
+	{
+		vecPairs.resize(n);
+		vecOrder.resize(n);
+
+		if (!(bTemporal && n == nLastCount && Repair(pKeys, n)))
+			RadixSort(pKeys, n);
+
+		for (uint32_t i = 0; i < n; i++)
+			vecOrder[i] = (uint32_t)vecPairs[i];
+		nLastCount = n;
+		return vecOrder;
+	}
+
+	sortMode LastMode() const { return lastMode; }
+	uint64_t Sorts(sortMode mode) const { return nSorts[mode]; }
+
+private:
+	void RadixSort(const uint32_t *pKeys, uint32_t n)
+	{
+		uint32_t nCount[nKeyBits / 8][256] = { 0 };
+		for (uint32_t i = 0; i < n; i++)
+		{
+			vecPairs[i] = (uint64_t)pKeys[i] << 32 | i;
+			for (uint32_t b = 0; b < nKeyBits / 8; b++)
+				nCount[b][(pKeys[i] >> (b * 8)) & 0xFF]++;
+		}
+
+		vecScratch.resize(n);
+		for (uint32_t b = 0; b < nKeyBits / 8; b++)
+		{
+			uint32_t *count = nCount[b];
+			if (n > 0 && count[(pKeys[0] >> (b * 8)) & 0xFF] == n)
+				continue; // this byte is the same everywhere
+
+			uint32_t nSum = 0;
+			for (int d = 0; d < 256; d++)
+			{
+				uint32_t c = count[d];
+				count[d] = nSum;
+				nSum += c;
+			}
+			for (uint32_t i = 0; i < n; i++)
+			{
+				uint64_t p = vecPairs[i];
+				vecScratch[count[(p >> (32 + b * 8)) & 0xFF]++] = p;
+			}
+			vecPairs.swap(vecScratch);
+		}
+
+		lastMode = SORT_RADIX;
+		nSorts[SORT_RADIX]++;
+	}
+
+	// Insertion sort from the last order, with fresh keys. Gives up after
+	// shifting a few elements per key on average.
+	bool Repair(const uint32_t *pKeys, uint32_t n)
+	{
+		for (uint32_t i = 0; i < n; i++)
+			vecPairs[i] = (uint64_t)pKeys[vecOrder[i]] << 32 | vecOrder[i];
+
+		uint64_t nBudget = 8 * (uint64_t)n;
+		for (uint32_t i = 1; i < n; i++)
+		{
+			uint64_t p = vecPairs[i];
+			uint32_t j = i;
+			while (j > 0 && vecPairs[j - 1] > p)
+			{
+				vecPairs[j] = vecPairs[j - 1];
+				j--;
+			}
+			vecPairs[j] = p;
+
+			nBudget -= min(nBudget, (uint64_t)(i - j));
+			if (nBudget == 0)
+				return false;
+		}
+
+		lastMode = SORT_TEMPORAL;
+		nSorts[SORT_TEMPORAL]++;
+		return true;
+	}
+
+	std::vector<uint64_t> vecPairs;
+	std::vector<uint64_t> vecScratch;
+	std::vector<uint32_t> vecOrder;
+	uint32_t nLastCount = 0;
+	sortMode lastMode = SORT_RADIX;
+	uint64_t nSorts[2] = { 0, 0 };
+};
+
+class ConsoleEngine3D : public olcConsoleGameEngine
+{
+public:
+	ConsoleEngine3D(const std::string &sModelFile = "teapot.obj") : sModelFile(sModelFile)
+	{
+		m_sAppName = L"Console Engine 3D";
+	}
+
+	// How long each stage of the last frame took. Transform is culling and the
+	// vertex stage, clip is everything done per triangle after it. Only timed
+	// during RunFrameBenchmark(), so the demo itself reads no extra clocks;
+	// otherwise all zero.
+	struct frameStages
+	{
+		double fTransformMs = 0.0;
+		double fClipMs = 0.0;
+		double fSortMs = 0.0;
+		double fRasterMs = 0.0;
+	};
+
+	const frameStages &LastFrameStages() const { return stages; }
+	uint32_t ModelTriangles() const { return sceneMain.vecMeshes[hTeapot].nIndices / 3; }
+	uint32_t TrianglesDrawn() const { return (uint32_t)vecTrianglesToRaster.size(); }
+
+private:
+	std::string sModelFile;
+	scene sceneMain;
+	meshHandle hTeapot = 0;
+	frameStages stages;
+	bool bTimeStages = false;
+
+	// G adds a field of extra teapots around the first one
+	bool bInstanceGrid = false;
+	mat4x4 matProj;
+	vec3d vCamera;
+	vec3d vLookDir; // unit direction 
+
+	float fYaw = 0.0f; // rotation in y-axis
+
+	float fTheta = 0.0f;
+
+	// Hidden surfaces: depth buffer, or sort back to front (painter's algorithm).
+	// Toggled with Z for comparison.
+	bool bDepthBuffer = true;
+
+	// Shades from dark to light, built once by BuildShadeRamp. Flat shading
+	// picks one per triangle. Gouraud shading (toggled with H) lights each
+	// vertex, interpolates across the triangle and dithers between shades.
+	static constexpr int nShadeLevels = 13;
+	CHAR_INFO shadeRamp[nShadeLevels];
+	bool bGouraud = false;
+	std::vector<float> vecVertLum;
+
+	// Painter's order. One depth key per triangle, sorted by depthSorter. While
+	// the camera only moves a little between frames the last frame's order is
+	// repaired rather than sorted from scratch; O turns that off.
+	bool bTemporalSort = true;
+	depthSorter sorter;
+	std::vector<uint32_t> vecDepthKeys;
+	vec3d vSortCamera;
+	float fSortYaw = 0.0f;
+
+	// Per-frame vertex stage output, reused between frames: clip-space position
+	// and outcode of every mesh vertex, and the screen position of those that
+	// have been through MapToViewport this frame (stamped with nFrameStamp)
+	vertexStream bufClipVerts;
+	std::vector<uint16_t> vecOutcodes;
+	std::vector<vec3d> vecScreenVerts;
+	std::vector<uint32_t> vecScreenStamp;
+	uint32_t nFrameStamp = 0;
+
+	// Output of ProjectMesh, kept between frames so it stops allocating
+	std::vector<triangle> vecTrianglesToRaster;
+
+	// BVH nodes of the current instance that passed frustum culling, and the
+	// merged vertex ranges they use
+	std::vector<uint32_t> vecVisibleNodes;
+	std::vector<std::pair<uint32_t, uint32_t>> vecVertRanges;
+
+	// Stats overlay, toggled with I. R refits the BVH again to re-time it.
+	bool bShowStats = false;
+	float fBvhRefitMs = 0.0f;
+	uint32_t nBvhNodesVisited = 0;
+	uint32_t nBvhNodesKept = 0;
+	uint32_t nTrianglesTested = 0;
+
+	// F caps the frame rate at 60, or lifts the cap again
+	bool bFrameCap = false;
+
+	// Level of detail: each instance is drawn with the coarsest level of its
+	// mesh whose error, projected to the screen at the instance's distance, is
+	// at most fLodErrorCells. L toggles it, - and = halve and double the limit.
+	bool bLod = true;
+	float fLodErrorCells = 0.5f;
+	uint32_t nInstancesAtLod[mesh::nMaxLods + 1] = { 0 };
+
+	// Tile-binned rasteriser: the screen is split into nTileSize square tiles,
+	// each triangle is listed, in submission order, in every tile its bounding
+	// box touches, and the tiles are drawn in parallel. A tile is only ever
+	// drawn by one thread and everything is clipped to it, so the result is the
+	// same as drawing the whole list in order on one thread. Toggled with T.
+	static constexpr int nTileSize = 32;
+	bool bTiledRaster = true;
+	std::unique_ptr<workerPool> rasterPool;
+	int nTilesX = 0;
+	int nTilesY = 0;
+	std::vector<std::vector<uint32_t>> vecTileBins;
+
+	vec3d MatrixMultiplyVector(mat4x4 &m, vec3d &i)
+	{
+		vec3d v;
+		v.x = i.x * m.m[0][0] + i.y * m.m[1][0] + i.z * m.m[2][0] + i.w * m.m[3][0];
+		v.y = i.x * m.m[0][1] + i.y * m.m[1][1] + i.z * m.m[2][1] + i.w * m.m[3][1];
+		v.z = i.x * m.m[0][2] + i.y * m.m[1][2] + i.z * m.m[2][2] + i.w * m.m[3][2];
+		v.w = i.x * m.m[0][3] + i.y * m.m[1][3] + i.z * m.m[2][3] + i.w * m.m[3][3];
+		return v;
+	}
+
+	mat4x4 MatrixMakeIdentity()
+	{
+		mat4x4 matrix;
+		matrix.m[0][0] = 1.0f;
+		matrix.m[1][1] = 1.0f;
+		matrix.m[2][2] = 1.0f;
+		matrix.m[3][3] = 1.0f;
+		return matrix;
+	}
+
+	mat4x4 MatrixMakeRotationX(float fAngleRad)
+	{
+		mat4x4 matrix;
+		matrix.m[0][0] = 1.0f;
+		matrix.m[1][1] = cosf(fAngleRad);
+		matrix.m[1][2] = sinf(fAngleRad);
+		matrix.m[2][1] = -sinf(fAngleRad);
+		matrix.m[2][2] = cosf(fAngleRad);
+		matrix.m[3][3] = 1.0f;
+		return matrix;
+	}
+
+	mat4x4 MatrixMakeRotationY(float fAngleRad)
+	{
+		mat4x4 matrix;
+		matrix.m[0][0] = cosf(fAngleRad);
+		matrix.m[0][2] = sinf(fAngleRad);
+		matrix.m[2][0] = -sinf(fAngleRad);
+		matrix.m[1][1] = 1.0f;
+		matrix.m[2][2] = cosf(fAngleRad);
+		matrix.m[3][3] = 1.0f;
+		return matrix;
+	}
+
+	mat4x4 MatrixMakeRotationZ(float fAngleRad)
+	{
+		mat4x4 matrix;
+		matrix.m[0][0] = cosf(fAngleRad);
+		matrix.m[0][1] = sinf(fAngleRad);
+		matrix.m[1][0] = -sinf(fAngleRad);
+		matrix.m[1][1] = cosf(fAngleRad);
+		matrix.m[2][2] = 1.0f;
+		matrix.m[3][3] = 1.0f;
+		return matrix;
+	}
+
+	mat4x4 MatrixMakeTranslation(float x, float y, float z)
+	{
+		mat4x4 matrix;
+		matrix.m[0][0] = 1.0f;
+		matrix.m[1][1] = 1.0f;
+		matrix.m[2][2] = 1.0f;
+		matrix.m[3][3] = 1.0f;
+		matrix.m[3][0] = x;
+		matrix.m[3][1] = y;
+		matrix.m[3][2] = z;
+		return matrix;
+	}
+
+	mat4x4 MatrixMakeProjection(float fFovDeg, float fAspectRatio, float fNear, float fFar)
+	{
+		// Projection matrix
+		float fFovRad = 1.0f / tanf(fFovDeg * 0.5f / 180.0f * 3.14159f);
+		mat4x4 matrix;
+		matrix.m[0][0] = fAspectRatio * fFovRad;
+		matrix.m[1][1] = fFovRad;
+		matrix.m[2][2] = fFar / (fFar - fNear);
+		matrix.m[3][2] = (-fNear * fFar) / (fFar - fNear);
+		matrix.m[2][3] = 1.0f;
+		matrix.m[3][3] = 0.0f;
+		return matrix;
+	}
+
+	mat4x4 MatrixMultiplyMatrix(mat4x4 &m1, mat4x4 &m2)
+	{
+		mat4x4 matrix;
+		for (int c = 0; c < 4; c++)
+		{
+			for (int r = 0; r < 4; r++)
+			{
+				matrix.m[r][c] = m1.m[r][0] * m2.m[0][c] + m1.m[r][1] * m2.m[1][c] + m1.m[r][2] * m2.m[2][c] + m1.m[r][3] * m2.m[3][c];
+			}
+		}
+		return matrix;
+	}
+
+	// position - obj should be
+	// target - forward vector for that object 
+	// up - up vector
+	mat4x4 MatrixPointAt(vec3d &pos, vec3d &target, vec3d &up)
+	{
+		// new forward vector
+		vec3d newForward = VectorSubtract(target, pos);
+		newForward = VectorNormalize(newForward);
+
+		// new up vector
+		vec3d a = VectorMultiply(newForward, VectorDotProduct(up, newForward));
+		vec3d newUp = VectorSubtract(up, a);
+		newUp = VectorNormalize(newUp);
+
+		// new right direction
+		vec3d newRight = VectorCrossProduct(newUp, newForward);
+
+		// create point-at matrix
+		mat4x4 matrix;
+		matrix.m[0][0] = newRight.x;
+		matrix.m[0][1] = newRight.y;
+		matrix.m[0][2] = newRight.z;
+		matrix.m[0][3] = 0.0f;
+		matrix.m[1][0] = newUp.x;
+		matrix.m[1][1] = newUp.y;
+		matrix.m[1][2] = newUp.z;
+		matrix.m[1][3] = 0.0f;
+		matrix.m[2][0] = newForward.x;
+		matrix.m[2][1] = newForward.y;
+		matrix.m[2][2] = newForward.z;
+		matrix.m[2][3] = 0.0f;
+		matrix.m[3][0] = pos.x;
+		matrix.m[3][1] = pos.y;
+		matrix.m[3][2] = pos.z;
+		matrix.m[3][3] = 1.0f;
+
+		return matrix;
+	}
+
+	// for rotation and translation only
+	mat4x4 MatrixQuickInverse(mat4x4 &m)
+	{
+		// create look-at matrix
+		mat4x4 matrix;
+		matrix.m[0][0] = m.m[0][0];
+		matrix.m[0][1] = m.m[1][0];
+		matrix.m[0][2] = m.m[2][0];
+		matrix.m[0][3] = 0.0f;
+		matrix.m[1][0] = m.m[0][1];
+		matrix.m[1][1] = m.m[1][1];
+		matrix.m[1][2] = m.m[2][1];
+		matrix.m[1][3] = 0.0f;
+		matrix.m[2][0] = m.m[0][2];
+		matrix.m[2][1] = m.m[1][2];
+		matrix.m[2][2] = m.m[2][2];
+		matrix.m[2][3] = 0.0f;
+		matrix.m[3][0] = -(m.m[3][0] * matrix.m[0][0] + m.m[3][1] * matrix.m[1][0] + m.m[3][2] * matrix.m[2][0]);
+		matrix.m[3][1] = -(m.m[3][0] * matrix.m[0][1] + m.m[3][1] * matrix.m[1][1] + m.m[3][2] * matrix.m[2][1]);
+		matrix.m[3][2] = -(m.m[3][0] * matrix.m[0][2] + m.m[3][1] * matrix.m[1][2] + m.m[3][2] * matrix.m[2][2]);
+		matrix.m[3][3] = 1.0f;
+
+		return matrix;
+	}
+
+	vec3d VectorAdd(vec3d & v1, vec3d & v2)
+	{
+		return { v1.x + v2.x, v1.y + v2.y, v1.z + v2.z };
+	}
+
+	vec3d VectorSubtract(vec3d & v1, vec3d & v2)
+	{
+		return { v1.x - v2.x, v1.y - v2.y, v1.z - v2.z };
+	}
+
+	vec3d VectorMultiply(vec3d & v1, float s)
+	{
+		return { v1.x * s, v1.y * s, v1.z * s };
+	}
+
+	vec3d VectorDivide(vec3d & v1, float s)
+	{
+		return { v1.x / s, v1.y / s, v1.z / s };
+	}
+
+	float VectorDotProduct(vec3d & v1, vec3d & v2)
+	{
+		return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+	}
+
+	float VectorLength(vec3d &v)
+	{
+		return sqrtf(VectorDotProduct(v, v));
+	}
+
+	vec3d VectorNormalize(vec3d & v)
+	{
+		float l = VectorLength(v);
+		return { v.x/l, v.y/l, v.z/l};
+	}
+
+	vec3d VectorCrossProduct(vec3d &v1, vec3d &v2)
+	{
+		vec3d v;
+		v.x = v1.y * v2.z - v1.z * v2.y;
+		v.y = v1.z * v2.x - v1.x * v2.z;
+		v.z = v1.x * v2.y - v1.y * v2.x;
+		return v;
+	}
+
+	// Clip-space outcodes. The first six say which frustum planes a vertex is
+	// outside of, and are only used to throw whole triangles away. Triangles are
+	// actually clipped against the near and far planes and against a guard band
+	// well outside the screen. Anything inside the guard band is left for the
+	// rasteriser, which only visits the on-screen part of a triangle, so the
+	// screen edges themselves never need clipping.
+	enum
+	{
+		CLIP_LEFT			= 1 << 0,
+		CLIP_RIGHT			= 1 << 1,
+		CLIP_BOTTOM			= 1 << 2,
+		CLIP_TOP			= 1 << 3,
+		CLIP_NEAR			= 1 << 4,
+		CLIP_FAR			= 1 << 5,
+		CLIP_GUARD_LEFT		= 1 << 6,
+		CLIP_GUARD_RIGHT	= 1 << 7,
+		CLIP_GUARD_BOTTOM	= 1 << 8,
+		CLIP_GUARD_TOP		= 1 << 9,
+
+		CLIP_FRUSTUM = CLIP_LEFT | CLIP_RIGHT | CLIP_BOTTOM | CLIP_TOP | CLIP_NEAR | CLIP_FAR,
+		CLIP_NEEDED = CLIP_NEAR | CLIP_FAR | CLIP_GUARD_LEFT | CLIP_GUARD_RIGHT | CLIP_GUARD_BOTTOM | CLIP_GUARD_TOP,
+	};
+
+	// Guard band half-width in normalised device coordinates - 2 reaches half
+	// a screen beyond each edge
+	static constexpr float fGuardBand = 2.0f;
+
+	static uint16_t ComputeOutcode(float x, float y, float z, float w)
+	{
+		float g = fGuardBand * w;
+		return (uint16_t)(
+			(x < -w ? CLIP_LEFT : 0) | (x > w ? CLIP_RIGHT : 0) |
+			(y < -w ? CLIP_BOTTOM : 0) | (y > w ? CLIP_TOP : 0) |
+			(z < 0.0f ? CLIP_NEAR : 0) | (z > w ? CLIP_FAR : 0) |
+			(x < -g ? CLIP_GUARD_LEFT : 0) | (x > g ? CLIP_GUARD_RIGHT : 0) |
+			(y < -g ? CLIP_GUARD_BOTTOM : 0) | (y > g ? CLIP_GUARD_TOP : 0));
+	}
+
+	// Each clip plane adds at most one vertex to the polygon, so clipping one
+	// triangle never gives more than nMaxClipTriangles when fanned back out
+	static constexpr int nClipPlaneCount = 6;
+	static constexpr int nMaxClipVerts = 3 + nClipPlaneCount;
+	static constexpr int nMaxClipTriangles = 16;
+	static_assert(nMaxClipVerts - 2 <= nMaxClipTriangles, "clipped polygon fans into too many triangles");
+
+	// Sutherland-Hodgman clip of a clip-space triangle against the planes flagged
+	// in nPlanes. Works entirely in fixed-size buffers on the stack. Returns the
+	// vertex count of the resulting convex polygon, 0 if nothing is left.
+	static int ClipPolygonHomogeneous(const vec3d(&in)[3], uint16_t nPlanes, vec3d(&out)[nMaxClipVerts])
+	{
+		return ClipPolygon<false>(in, nullptr, nPlanes, out, nullptr);
+	}
+
+	// As above, also carrying one attribute per vertex (such as light) through,
+	// interpolated the same way as the position
+	static int ClipPolygonHomogeneous(const vec3d(&in)[3], const float(&inAttr)[3], uint16_t nPlanes,
+		vec3d(&out)[nMaxClipVerts], float(&outAttr)[nMaxClipVerts])
+	{
+		return ClipPolygon<true>(in, inAttr, nPlanes, out, outAttr);
+	}
+
+	template<bool bAttr>
+	static int ClipPolygon(const vec3d(&in)[3], const float *pInAttr, uint16_t nPlanes, vec3d(&out)[nMaxClipVerts], float *pOutAttr)
+	{
+		// Plane (a, b, c, d): a point is inside when ax + by + cz + dw >= 0. Only
+		// the sign and the ratio da / (da - db) are used, and neither changes with
+		// the plane's scale, so there is nothing to normalise per call.
+		static const struct { uint16_t nBit; float a, b, c, d; } planes[nClipPlaneCount] =
+		{
+			{ CLIP_NEAR,			 0.0f,  0.0f,  1.0f, 0.0f },
+			{ CLIP_FAR,				 0.0f,  0.0f, -1.0f, 1.0f },
+			{ CLIP_GUARD_LEFT,		 1.0f,  0.0f,  0.0f, fGuardBand },
+			{ CLIP_GUARD_RIGHT,		-1.0f,  0.0f,  0.0f, fGuardBand },
+			{ CLIP_GUARD_BOTTOM,	 0.0f,  1.0f,  0.0f, fGuardBand },
+			{ CLIP_GUARD_TOP,		 0.0f, -1.0f,  0.0f, fGuardBand },
+		};
+
+		vec3d buf[2][nMaxClipVerts];
+		float attr[2][bAttr ? nMaxClipVerts : 1];
+		int n = 3;
+		int cur = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			buf[0][i] = in[i];
+			if constexpr (bAttr)
+				attr[0][i] = pInAttr[i];
+		}
+
+		for (auto &p : planes)
+		{
+			if (!(nPlanes & p.nBit))
+				continue;
+
+			const vec3d *src = buf[cur];
+			vec3d *dst = buf[cur ^ 1];
+			const float *srcAttr = attr[cur];
+			float *dstAttr = attr[cur ^ 1];
+			int m = 0;
+			for (int i = 0; i < n; i++)
+			{
+				int j = (i + 1) % n;
+				const vec3d &a = src[i];
+				const vec3d &b = src[j];
+				float da = p.a * a.x + p.b * a.y + p.c * a.z + p.d * a.w;
+				float db = p.a * b.x + p.b * b.y + p.c * b.z + p.d * b.w;
+
+				if (da >= 0.0f)
+				{
+					if constexpr (bAttr)
+						dstAttr[m] = srcAttr[i];
+					dst[m++] = a;
+				}
+
+				if ((da >= 0.0f) != (db >= 0.0f))
+				{
+					float t = da / (da - db);
+					if constexpr (bAttr)
+						dstAttr[m] = srcAttr[i] + (srcAttr[j] - srcAttr[i]) * t;
+					dst[m++] = { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t };
+				}
+			}
+
+			n = m;
+			cur ^= 1;
+			if (n < 3)
+				return 0;
+		}
+
+		for (int i = 0; i < n; i++)
+		{
+			out[i] = buf[cur][i];
+			if constexpr (bAttr)
+				pOutAttr[i] = attr[cur][i];
+		}
+		return n;
+	}
+
+	// Perspective divide and viewport mapping, done once per surviving vertex.
+	// X/Y come out inverted so put them back, then offset and scale into screen
+	// cells. z keeps the 0..1 depth, w keeps 1/w.
+	vec3d MapToViewport(const vec3d &v)
+	{
+		float fInvW = 1.0f / v.w;
+		vec3d s;
+		s.x = (1.0f - v.x * fInvW) * 0.5f * (float)ScreenWidth();
+		s.y = (1.0f - v.y * fInvW) * 0.5f * (float)ScreenHeight();
+		s.z = v.z * fInvW;
+		s.w = fInvW;
+		return s;
+	}
+
+	// View frustum planes of a model-view-projection matrix, in the model's own
+	// space: (a, b, c, d), with ax + by + cz + d >= 0 inside. Each is one of the
+	// clip-space tests (x >= -w, x <= w, ..., 0 <= z <= w) written out in terms
+	// of the untransformed point (Gribb & Hartmann).
+	struct frustumPlanes
+	{
+		float p[6][4];
+	};
+
+	static frustumPlanes MakeFrustumPlanes(const mat4x4 &m)
+	{
+		frustumPlanes f;
+		for (int r = 0; r < 4; r++)
+		{
+			f.p[0][r] = m.m[r][3] + m.m[r][0];	// left
+			f.p[1][r] = m.m[r][3] - m.m[r][0];	// right
+			f.p[2][r] = m.m[r][3] + m.m[r][1];	// bottom
+			f.p[3][r] = m.m[r][3] - m.m[r][1];	// top
+			f.p[4][r] = m.m[r][2];				// near
+			f.p[5][r] = m.m[r][3] - m.m[r][2];	// far
+		}
+		return f;
+	}
+
+	// Walks a mesh's BVH from the root. A node whose box is entirely outside
+	// any plane is dropped along with everything under it. One entirely inside
+	// a plane stops testing against it further down, and one inside all of them
+	// is taken whole. What is left - leaves and whole subtrees - goes into
+	// vecVisibleNodes.
+	void CullBvh(const mesh &m, const frustumPlanes &f)
+	{
+		vecVisibleNodes.clear();
+		if (m.vecBvh.empty())
+			return;
+
+		// The build halves every node, so the depth is well under the limit,
+		// and a cached tree is checked against it when loaded
+		struct entry { uint32_t nNode; uint32_t nPlanes; };
+		entry stack[mesh::nMaxBvhDepth + 1];
+		int nStack = 0;
+		stack[nStack++] = { 0, 0x3F };
+
+		while (nStack > 0)
+		{
+			entry e = stack[--nStack];
+			const bvhNode &node = m.vecBvh[e.nNode];
+			nBvhNodesVisited++;
+
+			bool bOutside = false;
+			for (int i = 0; i < 6 && !bOutside; i++)
+			{
+				if (!(e.nPlanes & (1 << i)))
+					continue;
+
+				// Box corners furthest along and against the plane normal
+				const float *p = f.p[i];
+				float fFar = p[3] + p[0] * (p[0] > 0.0f ? node.vMax.x : node.vMin.x) +
+					p[1] * (p[1] > 0.0f ? node.vMax.y : node.vMin.y) + p[2] * (p[2] > 0.0f ? node.vMax.z : node.vMin.z);
+				float fNear = p[3] + p[0] * (p[0] > 0.0f ? node.vMin.x : node.vMax.x) +
+					p[1] * (p[1] > 0.0f ? node.vMin.y : node.vMax.y) + p[2] * (p[2] > 0.0f ? node.vMin.z : node.vMax.z);
+
+				if (fFar < 0.0f)
+					bOutside = true;
+				else if (fNear >= 0.0f)
+					e.nPlanes &= ~(1u << i);
+			}
+			if (bOutside)
+				continue;
+
+			if (node.nLeft == 0 || e.nPlanes == 0)
+			{
+				vecVisibleNodes.push_back(e.nNode);
+				continue;
+			}
+
+			stack[nStack++] = { node.nLeft + 1, e.nPlanes };
+			stack[nStack++] = { node.nLeft, e.nPlanes };
+		}
+	}
+
+	// World matrix for the first model, and view matrix from the camera
+	void MakeWorldAndView(mat4x4 &matWorld, mat4x4 &matView)
+	{
+		mat4x4 matRotZ, matRotX;
+		//fTheta += 1.0f * _elapsedTime;
+
+		// Rotation Z
+		matRotZ = MatrixMakeRotationZ(fTheta * 0.5f);
+		// Rotation X
+		matRotX = MatrixMakeRotationX(fTheta);
+
+		mat4x4 matTrans;
+		matTrans = MatrixMakeTranslation(0.0f, 0.0f, 5.0f);
+
+		matWorld = MatrixMakeIdentity();
+		matWorld = MatrixMultiplyMatrix(matRotZ, matRotX);
+		matWorld = MatrixMultiplyMatrix(matWorld, matTrans);
+
+		// Up vector
+		vec3d vUp = { 0.0f, 1.0f, 0.0f };
+		//vec3d vTarget = VectorAdd(vCamera, vLookDir);
+		vec3d vTarget = { 0.0f,0.0f,1.0f };
+		mat4x4 matCameraRotation = MatrixMakeRotationY(fYaw);
+		vLookDir = MatrixMultiplyVector(matCameraRotation, vTarget);
+		vTarget = VectorAdd(vCamera, vLookDir);
+
+		mat4x4 matCamera = MatrixPointAt(vCamera, vTarget, vUp);
+		// make view matrix from camera
+		matView = MatrixQuickInverse(matCamera);
+	}
+
+	// Geometry stage for the whole scene: runs every instance through
+	// ProjectInstance, walking the world matrix array in order, and leaves the
+	// screen-space triangles in vecTrianglesToRaster. Makes no heap allocations
+	// once the buffers have grown to fit the scene.
+	void ProjectScene(mat4x4 &matView)
+	{
+		vecTrianglesToRaster.clear();
+		nBvhNodesVisited = 0;
+		nBvhNodesKept = 0;
+		nTrianglesTested = 0;
+		std::fill(std::begin(nInstancesAtLod), std::end(nInstancesAtLod), 0);
+
+		mat4x4 matViewProj = MatrixMultiplyMatrix(matView, matProj);
+		const uint32_t nInstances = sceneMain.InstanceCount();
+		for (uint32_t i = 0; i < nInstances; i++)
+		{
+			const mesh &m = sceneMain.vecMeshes[sceneMain.vecInstanceMesh[i]];
+			uint32_t nLod = bLod ? SelectLod(m, sceneMain.vecInstanceWorld[i]) : 0;
+			nInstancesAtLod[nLod]++;
+			ProjectInstance(m.GetLod(nLod), sceneMain.vecInstanceWorld[i], matViewProj);
+		}
+	}
+
+	// Coarsest level of detail of m that is good enough for an instance of it
+	// with this world matrix. The bounding sphere is projected to find how many
+	// cells across it will be, and so how many cells each level's error covers.
+	uint32_t SelectLod(const mesh &m, mat4x4 &matWorld)
+	{
+		vec3f vCentre;
+		float fRadius;
+		m.BoundingSphere(vCentre, fRadius);
+		vec3d vObject = { vCentre.x, vCentre.y, vCentre.z };
+		vec3d vWorld = MatrixMultiplyVector(matWorld, vObject);
+		vec3d vToCentre = VectorSubtract(vWorld, vCamera);
+		float fDistance = VectorLength(vToCentre);
+		if (fDistance <= fRadius || fRadius <= 0.0f)
+			return 0; // the camera is inside it
+
+		// Radius in cells, from the larger of the two projection scales
+		float fCellsPerUnit = max(matProj.m[0][0] * ScreenWidth(), matProj.m[1][1] * ScreenHeight()) * 0.5f / fDistance;
+		float fRadiusCells = fRadius * fCellsPerUnit;
+
+		uint32_t nLod = 0;
+		while (nLod + 1 < m.LodCount() && m.GetLod(nLod + 1).fLodError / fRadius * fRadiusCells <= fLodErrorCells)
+			nLod++;
+		return nLod;
+	}
+
+	// Milliseconds since t, which then moves on to now
+	static double LapMs(std::chrono::steady_clock::time_point &t)
+	{
+		auto tNow = std::chrono::steady_clock::now();
+		double fMs = std::chrono::duration<double, std::milli>(tNow - t).count();
+		t = tNow;
+		return fMs;
+	}
+
+	// Transforms, culls, lights and clips one instance of a mesh, adding its
+	// triangles to vecTrianglesToRaster
+	void ProjectInstance(const mesh &m, mat4x4 &matWorld, mat4x4 &matViewProj)
+	{
+		OLC_TRACE_ZONE_NAMED(zoneTransform, "transform");
+		std::chrono::steady_clock::time_point tLap;
+		if (bTimeStages)
+			tLap = std::chrono::steady_clock::now();
+		mat4x4 matMVP = MatrixMultiplyMatrix(matWorld, matViewProj);
+
+		// Throw away whole parts of the mesh that are out of view before
+		// anything is transformed
+		CullBvh(m, MakeFrustumPlanes(matMVP));
+		nBvhNodesKept += (uint32_t)vecVisibleNodes.size();
+
+		// Vertex stage: one premultiplied model-view-projection transform takes
+		// each vertex the visible nodes use straight to clip space, a run at a
+		// time. Vertices are numbered in BVH order, so after sorting and merging
+		// the nodes' ranges there are only a few runs.
+		vecVertRanges.clear();
+		for (uint32_t nNode : vecVisibleNodes)
+			vecVertRanges.push_back({ m.vecBvh[nNode].nVertFirst, m.vecBvh[nNode].nVertEnd });
+		std::sort(vecVertRanges.begin(), vecVertRanges.end());
+		size_t nRanges = 0;
+		for (auto &r : vecVertRanges)
+		{
+			if (nRanges > 0 && r.first <= vecVertRanges[nRanges - 1].second)
+				vecVertRanges[nRanges - 1].second = max(vecVertRanges[nRanges - 1].second, r.second);
+			else
+				vecVertRanges[nRanges++] = r;
+		}
+		vecVertRanges.resize(nRanges);
+
+		// Culling and lighting happen in object space, against the precomputed
+		// face and vertex normals, so bring the camera and light into it once rather than
+		// every triangle out to world space. matWorld is only ever rotation and
+		// translation, so this is exact.
+		mat4x4 matWorldInv = MatrixQuickInverse(matWorld);
+		vec3d vCameraObject = MatrixMultiplyVector(matWorldInv, vCamera);
+
+		// Illumination & its unit vector
+		vec3d lightDirection = { 0.0f, 1.0f, -1.0f };
+		lightDirection = VectorNormalize(lightDirection);
+		lightDirection.w = 0.0f;
+		vec3d lightObject = MatrixMultiplyVector(matWorldInv, lightDirection);
+
+		const uint32_t nVerts = m.nVerts;
+		bufClipVerts.Resize(nVerts);
+		vecOutcodes.resize(nVerts);
+		if (bGouraud)
+			vecVertLum.resize(nVerts);
+		for (auto &r : vecVertRanges)
+		{
+			TransformPoints(matMVP, m.pVertX + r.first, m.pVertY + r.first, m.pVertZ + r.first,
+				bufClipVerts.x.data() + r.first, bufClipVerts.y.data() + r.first, bufClipVerts.z.data() + r.first, bufClipVerts.w.data() + r.first,
+				r.second - r.first);
+
+			for (uint32_t i = r.first; i < r.second; i++)
+				vecOutcodes[i] = ComputeOutcode(bufClipVerts.x[i], bufClipVerts.y[i], bufClipVerts.z[i], bufClipVerts.w[i]);
+
+			if (bGouraud)
+			{
+				for (uint32_t i = r.first; i < r.second; i++)
+				{
+					const vec3f &n = m.pVertNormals[i];
+					vecVertLum[i] = max(0.1f, lightObject.x * n.x + lightObject.y * n.y + lightObject.z * n.z);
+				}
+			}
+		}
+
+		vecScreenVerts.resize(nVerts);
+		vecScreenStamp.resize(nVerts, 0);
+		if (++nFrameStamp == 0)
+		{
+			std::fill(vecScreenStamp.begin(), vecScreenStamp.end(), 0);
+			nFrameStamp = 1;
+		}
+		auto screenVertex = [&](uint32_t i) -> const vec3d&
+		{
+			if (vecScreenStamp[i] != nFrameStamp)
+			{
+				vecScreenVerts[i] = MapToViewport(bufClipVerts.Get(i));
+				vecScreenStamp[i] = nFrameStamp;
+			}
+			return vecScreenVerts[i];
+		};
+
+		if (bTimeStages)
+			stages.fTransformMs += LapMs(tLap);
+		OLC_TRACE_ZONE_END(zoneTransform);
+		OLC_TRACE_ZONE("clip");
+
+		// Draw Triangles
+		for (uint32_t nNode : vecVisibleNodes)
+		{
+			const bvhNode &node = m.vecBvh[nNode];
+			nTrianglesTested += node.nTriCount;
+			for (uint32_t t = node.nTriFirst; t < node.nTriFirst + node.nTriCount; t++)
+			{
+				const uint32_t *idx = &m.pIndices[t * 3];
+
+				// Ray from camera to triangle, skip it if it faces away
+				vec3d normal = { m.pFaceNormals[t].x, m.pFaceNormals[t].y, m.pFaceNormals[t].z };
+				vec3d p0 = { m.pVertX[idx[0]], m.pVertY[idx[0]], m.pVertZ[idx[0]] };
+				vec3d vCameraRay = VectorSubtract(p0, vCameraObject);
+				if (VectorDotProduct(normal, vCameraRay) >= 0.0f)
+					continue;
+
+				// Trivially rejected - all three vertices outside the same frustum plane
+				uint16_t oc0 = vecOutcodes[idx[0]];
+				uint16_t oc1 = vecOutcodes[idx[1]];
+				uint16_t oc2 = vecOutcodes[idx[2]];
+				if (oc0 & oc1 & oc2 & CLIP_FRUSTUM)
+					continue;
+
+				// Dot product b/w normal and light vector
+				float dp = max(0.1f, VectorDotProduct(lightObject, normal));
+
+				CHAR_INFO c = GetColour(dp);
+				triangle triProjected;
+				triProjected.col = c.Attributes;
+				triProjected.sym = c.Char.UnicodeChar;
+				for (int k = 0; k < 3; k++)
+					triProjected.lum[k] = bGouraud ? vecVertLum[idx[k]] : dp;
+
+				uint16_t nClipPlanes = (oc0 | oc1 | oc2) & CLIP_NEEDED;
+				if (nClipPlanes == 0)
+				{
+					// Trivially accepted, the common case - no clipping at all
+					triProjected.p[0] = screenVertex(idx[0]);
+					triProjected.p[1] = screenVertex(idx[1]);
+					triProjected.p[2] = screenVertex(idx[2]);
+					vecTrianglesToRaster.push_back(triProjected);
+				}
+				else
+				{
+					// Crosses the near or far plane, or the guard band. Clip in clip
+					// space and fan the resulting polygon back into triangles.
+					const vec3d clipIn[3] = { bufClipVerts.Get(idx[0]), bufClipVerts.Get(idx[1]), bufClipVerts.Get(idx[2]) };
+					vec3d polygon[nMaxClipVerts];
+					float polygonLum[nMaxClipVerts];
+					int n;
+					if (bGouraud)
+						n = ClipPolygonHomogeneous(clipIn, triProjected.lum, nClipPlanes, polygon, polygonLum);
+					else
+					{
+						n = ClipPolygonHomogeneous(clipIn, nClipPlanes, polygon);
+						std::fill(polygonLum, polygonLum + n, dp);
+					}
+					for (int i = 0; i < n; i++)
+						polygon[i] = MapToViewport(polygon[i]);
+
+					for (int i = 1; i + 1 < n; i++)
+					{
+						triProjected.p[0] = polygon[0];
+						triProjected.p[1] = polygon[i];
+						triProjected.p[2] = polygon[i + 1];
+						triProjected.lum[0] = polygonLum[0];
+						triProjected.lum[1] = polygonLum[i];
+						triProjected.lum[2] = polygonLum[i + 1];
+						vecTrianglesToRaster.push_back(triProjected);
+					}
+				}
+			}
+		}
+
+		if (bTimeStages)
+			stages.fClipMs += LapMs(tLap);
+	}
+
+	void RasterizeTriangle(const triangle &tri, const sRect &clip)
+	{
+		if (bGouraud)
+		{
+			// Light in ramp steps, centred so a flat triangle dithers to the
+			// shade flat shading would have picked. No outlines, they would
+			// only break up the gradients.
+			float s[3];
+			for (int k = 0; k < 3; k++)
+				s[k] = tri.lum[k] * nShadeLevels - 0.5f;
+
+			if (bDepthBuffer)
+				FillTriangleDepth(
+					tri.p[0].x, tri.p[0].y, tri.p[0].z, s[0],
+					tri.p[1].x, tri.p[1].y, tri.p[1].z, s[1],
+					tri.p[2].x, tri.p[2].y, tri.p[2].z, s[2],
+					shadeRamp, nShadeLevels, -1, clip
+				);
+			else
+				FillTriangleHalfSpace(
+					tri.p[0].x, tri.p[0].y, s[0],
+					tri.p[1].x, tri.p[1].y, s[1],
+					tri.p[2].x, tri.p[2].y, s[2],
+					shadeRamp, nShadeLevels, clip
+				);
+		}
+		else if (bDepthBuffer)
+		{
+			// The outline is part of the fill, so hidden edges stay hidden
+			FillTriangleDepth(
+				tri.p[0].x, tri.p[0].y, tri.p[0].z,
+				tri.p[1].x, tri.p[1].y, tri.p[1].z,
+				tri.p[2].x, tri.p[2].y, tri.p[2].z,
+				tri.sym, tri.col, FG_BLACK, clip
+			);
+		}
+		else
+		{
+			// DrawTriangle() => for wirefame
+			FillTriangleHalfSpace(
+				tri.p[0].x, tri.p[0].y,
+				tri.p[1].x, tri.p[1].y,
+				tri.p[2].x, tri.p[2].y,
+				tri.sym, tri.col, clip
+			);
+
+			DrawTriangle(
+				(int)tri.p[0].x, (int)tri.p[0].y,
+				(int)tri.p[1].x, (int)tri.p[1].y,
+				(int)tri.p[2].x, (int)tri.p[2].y,
+				PIXEL_SOLID, FG_BLACK, clip
+			);
+		}
+	}
+
+	// Back to front order of the triangles, by the depth of their centroids.
+	// 1 - z is quantised rather than z, as the depth of anything not right
+	// up against the near plane is very close to 1.
+	const std::vector<uint32_t> &SortBackToFront(const std::vector<triangle> &vecTris)
+	{
+		OLC_TRACE_ZONE("sort");
+		const float fScale = (float)((1u << depthSorter::nKeyBits) - 1);
+		vecDepthKeys.resize(vecTris.size());
+		for (size_t i = 0; i < vecTris.size(); i++)
+		{
+			const triangle &tri = vecTris[i];
+			float z = (tri.p[0].z + tri.p[1].z + tri.p[2].z) * (1.0f / 3.0f);
+			vecDepthKeys[i] = (uint32_t)(min(1.0f, max(0.0f, 1.0f - z)) * fScale);
+		}
+
+		// A small enough move leaves the order nearly right
+		vec3d vMoved = VectorSubtract(vCamera, vSortCamera);
+		bool bTemporal = bTemporalSort && VectorLength(vMoved) < 0.5f && fabsf(fYaw - fSortYaw) < 0.1f;
+		vSortCamera = vCamera;
+		fSortYaw = fYaw;
+
+		return sorter.Sort(vecDepthKeys.data(), (uint32_t)vecDepthKeys.size(), bTemporal);
+	}
+
+	// pOrder, if given, is the order to draw the triangles in
+	void RasterizeSerial(const std::vector<triangle> &vecTris, const std::vector<uint32_t> *pOrder)
+	{
+		OLC_TRACE_ZONE("fill");
+		Fill(0, 0, ScreenWidth(), ScreenHeight(), PIXEL_SOLID, FG_BLACK);
+		ClearDepth();
+
+		sRect screen = ScreenRect();
+		for (uint32_t i = 0; i < (uint32_t)vecTris.size(); i++)
+			RasterizeTriangle(vecTris[pOrder ? (*pOrder)[i] : i], screen);
+	}
+
+	void RasterizeTiled(const std::vector<triangle> &vecTris, const std::vector<uint32_t> *pOrder)
+	{
+		OLC_TRACE_ZONE_NAMED(zoneBin, "bin");
+		for (auto &bin : vecTileBins)
+			bin.clear();
+
+		// Bin by bounding box. floor/ceil covers the cells either rasteriser can
+		// touch, being too generous only costs a little time.
+		for (uint32_t i = 0; i < (uint32_t)vecTris.size(); i++)
+		{
+			uint32_t t = pOrder ? (*pOrder)[i] : i;
+			const triangle &tri = vecTris[t];
+			float fMinX = min(tri.p[0].x, min(tri.p[1].x, tri.p[2].x));
+			float fMaxX = max(tri.p[0].x, max(tri.p[1].x, tri.p[2].x));
+			float fMinY = min(tri.p[0].y, min(tri.p[1].y, tri.p[2].y));
+			float fMaxY = max(tri.p[0].y, max(tri.p[1].y, tri.p[2].y));
+
+			int nMinX = max(0, (int)floorf(fMinX));
+			int nMaxX = min(ScreenWidth() - 1, (int)ceilf(fMaxX));
+			int nMinY = max(0, (int)floorf(fMinY));
+			int nMaxY = min(ScreenHeight() - 1, (int)ceilf(fMaxY));
+			if (nMinX > nMaxX || nMinY > nMaxY)
+				continue;
+
+			for (int ty = nMinY / nTileSize; ty <= nMaxY / nTileSize; ty++)
+				for (int tx = nMinX / nTileSize; tx <= nMaxX / nTileSize; tx++)
+					vecTileBins[ty * nTilesX + tx].push_back(t);
+		}
+		OLC_TRACE_ZONE_END(zoneBin);
+
+		rasterPool->Run((uint32_t)vecTileBins.size(), [&](uint32_t nTile)
+		{
+			OLC_TRACE_ZONE("fill tile");
+			int tx = (int)nTile % nTilesX;
+			int ty = (int)nTile / nTilesX;
+			sRect tile;
+			tile.x1 = tx * nTileSize;
+			tile.y1 = ty * nTileSize;
+			tile.x2 = min(tile.x1 + nTileSize, ScreenWidth());
+			tile.y2 = min(tile.y1 + nTileSize, ScreenHeight());
+
+			ClearRect(tile, PIXEL_SOLID, FG_BLACK);
+			for (uint32_t t : vecTileBins[nTile])
+				RasterizeTriangle(vecTris[t], tile);
+		});
+	}
+
+public:
+	bool OnUserCreate() override
+	{
+		//hTeapot = sceneMain.LoadMesh("VideoShip.obj");
+		hTeapot = sceneMain.LoadMesh(sModelFile);
+		//hTeapot = sceneMain.LoadMesh("axis.obj");
+
+		// The spinning model. Its world matrix is set every frame.
+		sceneMain.AddInstance(hTeapot, MatrixMakeIdentity());
+
+		// Projection matrix
+		float fNear = 0.1f;
+		float fFar = 1000.0f;
+		float fFov = 90.0f; // 90 degrees
+		float fAspectRatio = (float)ScreenHeight() / (float)ScreenWidth();
+		//float fAspectRatio = (float)ScreenWidth() / (float)ScreenHeight();
+
+		matProj = MatrixMakeProjection(fFov, fAspectRatio, fNear, fFar);
+
+		EnableDepthBuffer();
+		EnableSpanDrawing();
+		BuildShadeRamp();
+
+		RefitSceneBvhs();
+		ReserveFrameBuffers();
+
+		// The game thread draws tiles too, so one fewer worker than cores
+		unsigned nCores = max(1u, std::thread::hardware_concurrency());
+		rasterPool = std::make_unique<workerPool>(nCores - 1);
+		nTilesX = (ScreenWidth() + nTileSize - 1) / nTileSize;
+		nTilesY = (ScreenHeight() + nTileSize - 1) / nTileSize;
+		vecTileBins.resize(nTilesX * nTilesY);
+
+		return true;
+	}
+
+	void RefitSceneBvhs()
+	{
+		auto tStart = std::chrono::steady_clock::now();
+		for (auto &m : sceneMain.vecMeshes)
+		{
+			m.RefitBvh();
+			for (auto &lod : m.vecLods)
+				lod.RefitBvh();
+		}
+		fBvhRefitMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+	}
+
+	// Makes the per-frame buffers big enough for everything in the scene to be
+	// visible at once, so frames don't grow them
+	void ReserveFrameBuffers()
+	{
+		// Any level of any mesh may be picked for an instance, so size the
+		// per-vertex buffers for the largest of them all
+		size_t nMaxNodes = 0, nMaxVerts = 0, nMaxTriangles = 0;
+		for (auto &m : sceneMain.vecMeshes)
+		{
+			for (uint32_t l = 0; l < m.LodCount(); l++)
+			{
+				const mesh &lod = m.GetLod(l);
+				nMaxNodes = max(nMaxNodes, lod.vecBvh.size());
+				nMaxVerts = max(nMaxVerts, (size_t)lod.nVerts);
+				nMaxTriangles = max(nMaxTriangles, (size_t)lod.nIndices / 3);
+			}
+		}
+		size_t nSceneTriangles = 0;
+		for (meshHandle h : sceneMain.vecInstanceMesh)
+			nSceneTriangles += sceneMain.vecMeshes[h].nIndices / 3;
+
+		vecVisibleNodes.reserve(nMaxNodes);
+		vecVertRanges.reserve(nMaxNodes);
+		bufClipVerts.Reserve(nMaxVerts);
+		vecOutcodes.reserve(nMaxVerts);
+		vecVertLum.reserve(nMaxVerts);
+		vecScreenVerts.reserve(nMaxVerts);
+		vecScreenStamp.reserve(nMaxVerts);
+
+		// One triangle out for each in, plus room for every triangle of the
+		// largest mesh to fan out as far as clipping can take it. Only those
+		// crossing a clip plane fan out, so reserving the full worst case for
+		// every instance, hundreds of megabytes with the grid, would be waste.
+		vecTrianglesToRaster.reserve(nSceneTriangles + nMaxTriangles * (nMaxClipTriangles - 1));
+	}
+
+	// Either just the spinning teapot, or that plus a 15 x 15 field of copies
+	// of it stretching away from the camera, each turned a different way
+	void SetInstanceGrid(bool bGrid)
+	{
+		sceneMain.TruncateInstances(1);
+		if (bGrid)
+		{
+			for (int z = 0; z < 15; z++)
+			{
+				for (int x = -7; x <= 7; x++)
+				{
+					mat4x4 matRot = MatrixMakeRotationY(0.7f * (float)(x * 15 + z));
+					mat4x4 matTrans = MatrixMakeTranslation(6.0f * (float)x, -3.0f, 12.0f + 6.0f * (float)z);
+					sceneMain.AddInstance(hTeapot, MatrixMultiplyMatrix(matRot, matTrans));
+				}
+			}
+		}
+		ReserveFrameBuffers();
+	}
+
+#ifdef CE3D_COUNT_ALLOCATIONS
+	// Clipper microbenchmark, run with Benchmark --clip. Needs no console, as only
+	// the geometry stage runs and all it needs is the screen size. First times
+	// ClipPolygonHomogeneous on its own over triangles that cross clip planes,
+	// then flies the camera through the model and counts the heap allocations
+	// each frame of ProjectScene makes.
+	int RunClipBenchmark()
+	{
+		m_nScreenWidth = 256;
+		m_nScreenHeight = 240;
+		if (!OnUserCreate())
+			return 1;
+		if (sceneMain.vecMeshes[hTeapot].nIndices == 0)
+		{
+			fprintf(stderr, "No mesh loaded\n");
+			return 1;
+		}
+
+		using clock = std::chrono::steady_clock;
+
+		// Random clip-space triangles reaching well past the guard band and both
+		// depth planes, so most get clipped against several planes
+		const int nTriangles = 4096;
+		const int nPasses = 200;
+		std::vector<vec3d> vecClipTris(nTriangles * 3);
+		uint32_t nSeed = 12345;
+		auto rnd = [&](float lo, float hi)
+		{
+			nSeed = nSeed * 1664525u + 1013904223u;
+			return lo + (hi - lo) * (float)(nSeed >> 8) / 16777216.0f;
+		};
+		for (auto &v : vecClipTris)
+			v = { rnd(-4.0f, 4.0f), rnd(-4.0f, 4.0f), rnd(-0.5f, 1.5f), 1.0f };
+
+		uint64_t nAllocsBefore = nHeapAllocations;
+		uint64_t nVertsOut = 0;
+		auto tStart = clock::now();
+		for (int pass = 0; pass < nPasses; pass++)
+		{
+			for (int t = 0; t < nTriangles; t++)
+			{
+				const vec3d in[3] = { vecClipTris[t * 3], vecClipTris[t * 3 + 1], vecClipTris[t * 3 + 2] };
+				vec3d polygon[nMaxClipVerts];
+				nVertsOut += ClipPolygonHomogeneous(in, CLIP_NEEDED, polygon);
+			}
+		}
+		double fClipNs = std::chrono::duration<double, std::nano>(clock::now() - tStart).count() / ((double)nTriangles * nPasses);
+		uint64_t nClipAllocs = nHeapAllocations - nAllocsBefore;
+
+		printf("clipper: %.1f ns/triangle, %.2f vertices out on average, %llu heap allocations\n",
+			fClipNs, (double)nVertsOut / ((double)nTriangles * nPasses), (unsigned long long)nClipAllocs);
+
+		// Whole frames, with the camera starting outside the model and ending up
+		// inside it, so the near plane cuts through it for much of the way
+		const int nFrames = 300;
+		uint64_t nFirstFrameAllocs = 0;
+		uint64_t nLaterAllocs = 0;
+		uint64_t nLaterMaxAllocs = 0;
+		size_t nTrianglesOut = 0;
+		tStart = clock::now();
+		for (int f = 0; f < nFrames; f++)
+		{
+			vCamera = { 0.0f, 0.5f, -2.0f + 9.0f * (float)f / (float)nFrames };
+			mat4x4 matView;
+			MakeWorldAndView(sceneMain.vecInstanceWorld[0], matView);
+
+			nAllocsBefore = nHeapAllocations;
+			ProjectScene(matView);
+			uint64_t nAllocs = nHeapAllocations - nAllocsBefore;
+
+			if (f == 0)
+				nFirstFrameAllocs = nAllocs;
+			else
+			{
+				nLaterAllocs += nAllocs;
+				nLaterMaxAllocs = max(nLaterMaxAllocs, nAllocs);
+			}
+			nTrianglesOut += vecTrianglesToRaster.size();
+		}
+		double fFrameMs = std::chrono::duration<double, std::milli>(clock::now() - tStart).count() / nFrames;
+
+		printf("frames: %.3f ms geometry/frame, %.0f triangles out/frame\n", fFrameMs, (double)nTrianglesOut / nFrames);
+		printf("heap allocations: %llu in the first frame, then %.2f/frame on average and %llu at most\n",
+			(unsigned long long)nFirstFrameAllocs, (double)nLaterAllocs / (nFrames - 1), (unsigned long long)nLaterMaxAllocs);
+
+		return nLaterAllocs == 0 ? 0 : 1;
+	}
+#endif
+
+	// End-to-end frame benchmark, for the Benchmark project. Needs a screen,
+	// which can be headless. Flies the camera along a fixed script of held
+	// keys, the same ones a player would use, for nFrames frames of fTimeStep
+	// seconds each, and writes the frame times and the time each stage took
+	// to pJson. Present is encoding the frame for a VT terminal, everything
+	// short of the write itself. The first nWarmup frames are not counted.
+	int RunFrameBenchmark(int nFrames, int nWarmup, float fTimeStep, bool bGrid, bool bPainter, FILE *pJson)
+	{
+		if (nFrames <= 0 || nWarmup < 0 || !OnUserCreate())
+			return 1;
+		if (ModelTriangles() == 0)
+		{
+			fprintf(stderr, "No mesh loaded\n");
+			return 1;
+		}
+		bTimeStages = true;
+
+		// Each step holds its keys for a number of frames. The script loops.
+		struct scriptStep
+		{
+			int nFrames;
+			int nKeys[2];
+		};
+		static const scriptStep script[] =
+		{
+			{ 60, { L'A', 0 } },
+			{ 40, { L'W', 0 } },
+			{ 90, { L'D', 0 } },
+			{ 30, { VK_UP, L'W' } },
+			{ 60, { L'S', L'A' } },
+			{ 45, { VK_LEFT, 0 } },
+			{ 30, { VK_DOWN, 0 } },
+			{ 60, { VK_RIGHT, L'D' } },
+			{ 45, { L'S', 0 } },
+		};
+
+		if (bGrid)
+		{
+			bInstanceGrid = true;
+			SetInstanceGrid(true);
+		}
+		bDepthBuffer = !bPainter;
+
+		using clock = std::chrono::steady_clock;
+		std::vector<double> vecFrameMs, vecTransformMs, vecClipMs, vecSortMs, vecRasterMs, vecPresentMs;
+		double fTrianglesDrawn = 0.0, fPresentBytes = 0.0;
+		size_t nStep = 0;
+		int nStepFrame = 0;
+		for (int f = 0; f < nWarmup + nFrames; f++)
+		{
+			for (int k = 0; k < 256; k++)
+				m_keys[k].bHeld = false;
+			for (int k : script[nStep].nKeys)
+				if (k != 0)
+					m_keys[k].bHeld = true;
+			if (++nStepFrame == script[nStep].nFrames)
+			{
+				nStep = (nStep + 1) % (sizeof(script) / sizeof(script[0]));
+				nStepFrame = 0;
+			}
+
+			auto tStart = clock::now();
+			OnUserUpdate(fTimeStep);
+			auto tPresent = clock::now();
+			size_t nPresentBytes = EncodeTerminalFrame().size();
+			auto tEnd = clock::now();
+
+			if (f < nWarmup)
+				continue;
+
+			vecFrameMs.push_back(std::chrono::duration<double, std::milli>(tEnd - tStart).count());
+			vecTransformMs.push_back(stages.fTransformMs);
+			vecClipMs.push_back(stages.fClipMs);
+			vecSortMs.push_back(stages.fSortMs);
+			vecRasterMs.push_back(stages.fRasterMs);
+			vecPresentMs.push_back(std::chrono::duration<double, std::milli>(tEnd - tPresent).count());
+			fTrianglesDrawn += vecTrianglesToRaster.size();
+			fPresentBytes += nPresentBytes;
+		}
+
+		// Mean, median, 99th percentile and worst of a set of times
+		auto stats = [&](const char *sName, std::vector<double> &vec, bool bLast)
+		{
+			double fSum = 0.0;
+			for (double t : vec)
+				fSum += t;
+			std::sort(vec.begin(), vec.end());
+			auto rank = [&](double p) { return vec[min(vec.size() - 1, (size_t)(p * (double)vec.size()))]; };
+			fprintf(pJson, "    \"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+				sName, fSum / (double)vec.size(), rank(0.5), rank(0.99), vec.back(), bLast ? "" : ",");
+		};
+
+		// Windows paths are full of backslashes
+		std::string sModelJson;
+		for (char c : sModelFile)
+		{
+			if (c == '\\' || c == '"')
+				sModelJson += '\\';
+			sModelJson += c;
+		}
+
+		fprintf(pJson, "{\n");
+		fprintf(pJson, "  \"model\": \"%s\",\n", sModelJson.c_str());
+		fprintf(pJson, "  \"model_triangles\": %u,\n", ModelTriangles());
+		fprintf(pJson, "  \"instances\": %u,\n", sceneMain.InstanceCount());
+		fprintf(pJson, "  \"screen\": [%d, %d],\n", ScreenWidth(), ScreenHeight());
+		fprintf(pJson, "  \"frames\": %d,\n", nFrames);
+		fprintf(pJson, "  \"warmup_frames\": %d,\n", nWarmup);
+		fprintf(pJson, "  \"timestep\": %.6f,\n", fTimeStep);
+		fprintf(pJson, "  \"hidden_surfaces\": \"%s\",\n", bDepthBuffer ? "depth buffer" : "painter");
+		fprintf(pJson, "  \"triangles_drawn_mean\": %.1f,\n", fTrianglesDrawn / nFrames);
+		fprintf(pJson, "  \"present_bytes_mean\": %.1f,\n", fPresentBytes / nFrames);
+		fprintf(pJson, "  \"frame_ms\": {\n");
+		stats("total", vecFrameMs, false);
+		stats("transform", vecTransformMs, false);
+		stats("clip", vecClipMs, false);
+		stats("sort", vecSortMs, false);
+		stats("raster", vecRasterMs, false);
+		stats("present", vecPresentMs, true);
+		fprintf(pJson, "  }\n");
+		fprintf(pJson, "}\n");
+		return 0;
+	}
+
+	// Light level 0..1 to a cell, from the shade ramp
+	CHAR_INFO GetColour(float lum)
+	{
+		return shadeRamp[min(nShadeLevels - 1, max(0, (int)(nShadeLevels * lum)))];
+	}
+
+	void BuildShadeRamp()
+	{
+		for (int i = 0; i < nShadeLevels; i++)
+			shadeRamp[i] = ShadeLevel(i);
+	}
+
+	// Taken From Command Line Webcam Video
+	CHAR_INFO ShadeLevel(int pixel_bw)
+	{
+		short bg_col, fg_col;
+		wchar_t sym;
+		switch (pixel_bw)
+		{
+		case 0: bg_col = BG_BLACK; fg_col = FG_BLACK; sym = PIXEL_SOLID; break;
+
+		case 1: bg_col = BG_BLACK; fg_col = FG_DARK_GREY; sym = PIXEL_QUARTER; break;
+		case 2: bg_col = BG_BLACK; fg_col = FG_DARK_GREY; sym = PIXEL_HALF; break;
+		case 3: bg_col = BG_BLACK; fg_col = FG_DARK_GREY; sym = PIXEL_THREEQUARTERS; break;
+		case 4: bg_col = BG_BLACK; fg_col = FG_DARK_GREY; sym = PIXEL_SOLID; break;
+
+		case 5: bg_col = BG_DARK_GREY; fg_col = FG_GREY; sym = PIXEL_QUARTER; break;
+		case 6: bg_col = BG_DARK_GREY; fg_col = FG_GREY; sym = PIXEL_HALF; break;
+		case 7: bg_col = BG_DARK_GREY; fg_col = FG_GREY; sym = PIXEL_THREEQUARTERS; break;
+		case 8: bg_col = BG_DARK_GREY; fg_col = FG_GREY; sym = PIXEL_SOLID; break;
+
+		case 9:  bg_col = BG_GREY; fg_col = FG_WHITE; sym = PIXEL_QUARTER; break;
+		case 10: bg_col = BG_GREY; fg_col = FG_WHITE; sym = PIXEL_HALF; break;
+		case 11: bg_col = BG_GREY; fg_col = FG_WHITE; sym = PIXEL_THREEQUARTERS; break;
+		case 12: bg_col = BG_GREY; fg_col = FG_WHITE; sym = PIXEL_SOLID; break;
+		default:
+			bg_col = BG_BLACK; fg_col = FG_BLACK; sym = PIXEL_SOLID;
+		}
+
+		CHAR_INFO c;
+		c.Attributes = bg_col | fg_col;
+		c.Char.UnicodeChar = sym;
+		return c;
+	}
+
+	bool OnUserUpdate(float _elapsedTime) override
+	{
+		vLookDir = { 0.0f, 0.0f, 0.0f };
+
+		// key press movement
+		if (GetKey(VK_UP).bHeld)
+			vCamera.y += 8.0f * _elapsedTime;
+		if (GetKey(VK_DOWN).bHeld)
+			vCamera.y -= 8.0f * _elapsedTime;
+		if (GetKey(VK_LEFT).bHeld)
+			vCamera.x -= 8.0f * _elapsedTime;
+		if (GetKey(VK_RIGHT).bHeld)
+			vCamera.x += 8.0f * _elapsedTime;
+
+		vec3d vForward = VectorMultiply(vLookDir, 8.0f * _elapsedTime); // Forward velocity vector
+
+		if (GetKey(L'A').bHeld)
+			fYaw -= 2.0f * _elapsedTime;
+		if (GetKey(L'D').bHeld)
+			fYaw += 2.0f * _elapsedTime;
+		
+		if (GetKey(L'W').bHeld)
+			vCamera = VectorAdd(vCamera, vForward);
+		if (GetKey(L'S').bHeld)
+			vCamera = VectorSubtract(vCamera, vForward);
+
+		if (GetKey(L'Z').bPressed)
+			bDepthBuffer = !bDepthBuffer;
+		if (GetKey(L'T').bPressed)
+			bTiledRaster = !bTiledRaster;
+		if (GetKey(L'I').bPressed)
+			bShowStats = !bShowStats;
+		if (GetKey(L'R').bPressed)
+			RefitSceneBvhs();
+		if (GetKey(L'G').bPressed)
+		{
+			bInstanceGrid = !bInstanceGrid;
+			SetInstanceGrid(bInstanceGrid);
+		}
+		if (GetKey(L'H').bPressed)
+			bGouraud = !bGouraud;
+		if (GetKey(L'O').bPressed)
+			bTemporalSort = !bTemporalSort;
+		if (GetKey(L'L').bPressed)
+			bLod = !bLod;
+		if (GetKey(VK_OEM_MINUS).bPressed)
+			fLodErrorCells = max(1.0f / 16.0f, fLodErrorCells * 0.5f);
+		if (GetKey(VK_OEM_PLUS).bPressed)
+			fLodErrorCells = min(16.0f, fLodErrorCells * 2.0f);
+		if (GetKey(L'F').bPressed)
+		{
+			bFrameCap = !bFrameCap;
+			SetTargetFrameRate(bFrameCap ? 60.0f : 0.0f);
+		}
+		if (GetKey(L'P').bPressed)
+			SaveTrace(L"trace.json");	// Only does anything in builds with OLC_TRACE defined
+
+		stages = frameStages();
+		mat4x4 matView;
+		MakeWorldAndView(sceneMain.vecInstanceWorld[0], matView);
+		ProjectScene(matView);
+
+		// Only the painter's algorithm cares about order. Depth tested triangles
+		// are drawn in whatever order they came out of the mesh.
+		std::chrono::steady_clock::time_point tLap;
+		if (bTimeStages)
+			tLap = std::chrono::steady_clock::now();
+		const std::vector<uint32_t> *pOrder = nullptr;
+		if (!bDepthBuffer)
+			pOrder = &SortBackToFront(vecTrianglesToRaster);
+		if (bTimeStages)
+			stages.fSortMs = LapMs(tLap);
+
+		// Draw. Everything is inside the guard band, and the rasteriser skips
+		// whatever part of a triangle is off screen.
+		if (bTiledRaster)
+			RasterizeTiled(vecTrianglesToRaster, pOrder);
+		else
+			RasterizeSerial(vecTrianglesToRaster, pOrder);
+		if (bTimeStages)
+			stages.fRasterMs = LapMs(tLap);
+
+		if (bShowStats)
+		{
+			size_t nGeometryBytes = 0, nBvhNodes = 0;
+			float fBuildMs = 0.0f, fLodBuildMs = 0.0f;
+			bool bBuilt = false;
+			for (auto &m : sceneMain.vecMeshes)
+			{
+				nGeometryBytes += m.GeometryBytes();
+				nBvhNodes += m.vecBvh.size();
+				if (m.fBvhBuildMs >= 0.0f)
+				{
+					fBuildMs += m.fBvhBuildMs;
+					bBuilt = true;
+				}
+				if (m.fLodBuildMs >= 0.0f)
+					fLodBuildMs += m.fLodBuildMs;
+			}
+			uint32_t nSceneTriangles = 0;
+			for (meshHandle h : sceneMain.vecInstanceMesh)
+				nSceneTriangles += sceneMain.vecMeshes[h].nIndices / 3;
+			size_t nInstanceBytes = sceneMain.InstanceCount() * (sizeof(mat4x4) + sizeof(meshHandle));
+
+			wchar_t s[256];
+			swprintf_s(s, 256, L"%u instances of %u meshes, %.1f KB geometry + %.1f KB instances", sceneMain.InstanceCount(),
+				(unsigned)sceneMain.vecMeshes.size(), nGeometryBytes / 1024.0f, nInstanceBytes / 1024.0f);
+			DrawString(0, 0, s, FG_WHITE);
+			if (bBuilt)
+				swprintf_s(s, 256, L"BVH %u nodes, build %.2f ms, refit %.2f ms", (unsigned)nBvhNodes, fBuildMs, fBvhRefitMs);
+			else
+				swprintf_s(s, 256, L"BVH %u nodes, cached, refit %.2f ms", (unsigned)nBvhNodes, fBvhRefitMs);
+			DrawString(0, 1, s, FG_WHITE);
+			swprintf_s(s, 256, L"Visited %u nodes, kept %u, tested %u of %u triangles", nBvhNodesVisited,
+				nBvhNodesKept, nTrianglesTested, nSceneTriangles);
+			DrawString(0, 2, s, FG_WHITE);
+
+			int n = swprintf_s(s, 256, L"LOD %ls, max error %.3g cells, instances per level:", bLod ? L"on" : L"off", fLodErrorCells);
+			for (uint32_t l = 0; l <= mesh::nMaxLods && n > 0; l++)
+				n += swprintf_s(s + n, 256 - n, L" %u", nInstancesAtLod[l]);
+			if (bBuilt)
+				swprintf_s(s + n, 256 - n, L", built in %.1f ms", fLodBuildMs);
+			DrawString(0, 3, s, FG_WHITE);
+
+			if (bDepthBuffer)
+				swprintf_s(s, 256, L"Depth buffer, no sorting");
+			else
+				swprintf_s(s, 256, L"Painter's order: %ls this frame, %llu radix and %llu temporal sorts so far",
+					sorter.LastMode() == depthSorter::SORT_TEMPORAL ? L"temporal" : L"radix",
+					(unsigned long long)sorter.Sorts(depthSorter::SORT_RADIX), (unsigned long long)sorter.Sorts(depthSorter::SORT_TEMPORAL));
+			DrawString(0, 4, s, FG_WHITE);
+
+			swprintf_s(s, 256, L"%ls shading", bGouraud ? L"Gouraud" : L"Flat");
+			DrawString(0, 5, s, FG_WHITE);
+
+			sFramePacing pacing = FramePacing();
+			swprintf_s(s, 256, L"Frames %ls: %.2f ms apart, jitter %.2f ms, worst %.2f ms, %llu dropped by the presenter, input to present %.1f ms",
+				bFrameCap ? L"capped at 60" : L"uncapped", pacing.fMeanMs, pacing.fJitterMs, pacing.fWorstMs, (unsigned long long)FramesDropped(), InputToPhotonMs());
+			DrawString(0, 6, s, FG_WHITE);
+
+			if (PresentedBytesAverage() > 0.0)
+			{
+				swprintf_s(s, 256, L"Terminal: %.1f KB last frame, %.1f KB per frame on average",
+					PresentedBytes() / 1024.0, PresentedBytesAverage() / 1024.0);
+				DrawString(0, 7, s, FG_WHITE);
+			}
+		}
+
+		return true;
+	}
+};
@@ -121,6 +121,8 @@ http://www.twitch.tv/javidx9
 */
 
 #pragma once
+
+#ifdef _WIN32
 #pragma comment(lib, "winmm.lib")
 
 #ifndef UNICODE
@@ -129,6 +131,85 @@ Character Set -> Use Unicode. Thanks! - Javidx9
 #endif
 
 #include <windows.h>
+#else
+// Without Windows there is no console to draw into, so only the headless
+// target (see ConstructHeadless()) is available. These stand in for the few
+// bits of windows.h the engine and its applications use.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cwchar>
+#include <cstdarg>
+#include <string>
+#include <mutex>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+struct CHAR_INFO
+{
+	union
+	{
+		wchar_t UnicodeChar;
+		char AsciiChar;
+	} Char;
+	unsigned short Attributes;
+};
+
+#pragma pack(push, 1)
+struct WAVEFORMATEX
+{
+	uint16_t wFormatTag;
+	uint16_t nChannels;
+	uint32_t nSamplesPerSec;
+	uint32_t nAvgBytesPerSec;
+	uint16_t nBlockAlign;
+	uint16_t wBitsPerSample;
+	uint16_t cbSize;
+};
+#pragma pack(pop)
+
+#define MAXSHORT 0x7FFF
+
+enum
+{
+	VK_BACK = 0x08, VK_TAB = 0x09, VK_RETURN = 0x0D, VK_SHIFT = 0x10, VK_CONTROL = 0x11,
+	VK_MENU = 0x12, VK_ESCAPE = 0x1B, VK_SPACE = 0x20, VK_PRIOR = 0x21, VK_NEXT = 0x22,
+	VK_END = 0x23, VK_HOME = 0x24, VK_LEFT = 0x25, VK_UP = 0x26, VK_RIGHT = 0x27,
+	VK_DOWN = 0x28, VK_INSERT = 0x2D, VK_DELETE = 0x2E, VK_F1 = 0x70, VK_F2 = 0x71,
+	VK_F3 = 0x72, VK_F4 = 0x73, VK_F5 = 0x74, VK_F6 = 0x75, VK_F7 = 0x76, VK_F8 = 0x77,
+	VK_F9 = 0x78, VK_F10 = 0x79, VK_F11 = 0x7A, VK_F12 = 0x7B, VK_OEM_PLUS = 0xBB,
+	VK_OEM_COMMA = 0xBC, VK_OEM_MINUS = 0xBD, VK_OEM_PERIOD = 0xBE,
+};
+
+// windows.h has min and max macros, which applications use unqualified
+using std::min;
+using std::max;
+
+inline int swprintf_s(wchar_t *buf, size_t nSize, const wchar_t *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int n = vswprintf(buf, nSize, format, args);
+	va_end(args);
+	return n;
+}
+
+inline int _wfopen_s(FILE **pFile, const wchar_t *sFile, const wchar_t *sMode)
+{
+	std::string sName(std::wcslen(sFile) * MB_CUR_MAX + 1, '\0');
+	std::string sFlags(std::wcslen(sMode) + 1, '\0');
+	std::wcstombs(&sName[0], sFile, sName.size());
+	std::wcstombs(&sFlags[0], sMode, sFlags.size());
+	*pFile = std::fopen(sName.c_str(), sFlags.c_str());
+	return *pFile == nullptr ? 1 : 0;
+}
+#endif
 
 #include <iostream>
 #include <chrono>
@@ -137,6 +218,19 @@ Character Set -> Use Unicode. Thanks! - Javidx9
 #include <thread>
 #include <atomic>
 #include <condition_variable>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cmath>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+// SSE2 is always there on x64, and on x86 when the compiler was told to use it
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define OLC_SSE2
+#include <emmintrin.h>
+#endif
 
 enum COLOUR
 {
@@ -254,6 +348,17 @@ public:
 			return m_Colours[y * nWidth + x];
 	}
 
+	// Whole rows at once, for drawing. y must be in range.
+	const short *GlyphRow(int y) const
+	{
+		return &m_Glyphs[y * nWidth];
+	}
+
+	const short *ColourRow(int y) const
+	{
+		return &m_Colours[y * nWidth];
+	}
+
 	short SampleGlyph(float x, float y)
 	{
 		int sx = (int)(x * (float)nWidth);
@@ -316,6 +421,618 @@ public:
 	}
 };
 
+// Hot path tracing, compiled in only when OLC_TRACE is defined. A zone times
+// the scope it is declared in:
+//
+//	OLC_TRACE_ZONE("present");
+//
+// or, to close it before the end of the scope, give it a name and end it:
+//
+//	OLC_TRACE_ZONE_NAMED(zoneSort, "sort");
+//	...
+//	OLC_TRACE_ZONE_END(zoneSort);
+//
+// Each thread writes its zones into its own ring of the most recent
+// nRingSize, so recording takes no locks and never allocates after the
+// thread's first zone. olcTrace::Save() writes every thread's ring out in
+// Chrome's trace event format, for chrome://tracing or Perfetto. Zone and
+// thread names must be string literals, or otherwise outlive the trace.
+#ifdef OLC_TRACE
+class olcTrace
+{
+public:
+	static const uint32_t nRingSize = 1 << 16;
+
+	struct sEvent
+	{
+		const char *sName;
+		uint64_t nStart;	// ns since the first zone anywhere
+		uint64_t nEnd;
+	};
+
+	static uint64_t Now()
+	{
+		static const auto tEpoch = std::chrono::steady_clock::now();
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - tEpoch).count();
+	}
+
+	// The slot is written with relaxed atomics, so Save() may read it at the
+	// same time. The fence means a Save() that sees any of the new values also
+	// sees the head at nHead, and so knows the slot is being overwritten.
+	static void Record(const char *sName, uint64_t nStart, uint64_t nEnd)
+	{
+		sRing &ring = ThreadRing();
+		uint64_t nHead = ring.nHead.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		sSlot &slot = ring.events[nHead & (nRingSize - 1)];
+		slot.sName.store(sName, std::memory_order_relaxed);
+		slot.nStart.store(nStart, std::memory_order_relaxed);
+		slot.nEnd.store(nEnd, std::memory_order_relaxed);
+		ring.nHead.store(nHead + 1, std::memory_order_release);
+	}
+
+	static void NameThread(const char *sName)
+	{
+		ThreadRing().sName.store(sName, std::memory_order_relaxed);
+	}
+
+	// Safe to call while other threads are still recording, as a seqlock
+	// reader: zones they overwrite while it runs are left out.
+	static bool Save(const std::wstring &sFile)
+	{
+		FILE *f = nullptr;
+		_wfopen_s(&f, sFile.c_str(), L"w");
+		if (f == nullptr)
+			return false;
+
+		std::vector<sEvent> vecEvents;
+		std::lock_guard<std::mutex> lock(Registry().mux);
+		fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		bool bFirst = true;
+		for (size_t t = 0; t < Registry().vecRings.size(); t++)
+		{
+			sRing &ring = *Registry().vecRings[t];
+			fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+				bFirst ? "" : ",\n", t, ring.sName.load(std::memory_order_relaxed));
+			bFirst = false;
+
+			uint64_t nHead = ring.nHead.load(std::memory_order_acquire);
+			uint64_t nFirst = nHead > nRingSize ? nHead - nRingSize : 0;
+			vecEvents.clear();
+			for (uint64_t i = nFirst; i < nHead; i++)
+			{
+				const sSlot &slot = ring.events[i & (nRingSize - 1)];
+				vecEvents.push_back({ slot.sName.load(std::memory_order_relaxed),
+					slot.nStart.load(std::memory_order_relaxed), slot.nEnd.load(std::memory_order_relaxed) });
+			}
+
+			// Anything the owner has started writing over since is suspect. The
+			// fence keeps the copies above from being read after the head is.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint64_t nHeadAfter = ring.nHead.load(std::memory_order_acquire);
+			uint64_t nValidFrom = nHeadAfter + 1 > nRingSize ? nHeadAfter + 1 - nRingSize : 0;
+			for (uint64_t i = (std::max)(nFirst, nValidFrom); i < nHead; i++)
+			{
+				const sEvent &e = vecEvents[i - nFirst];
+				fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}",
+					e.sName, t, e.nStart / 1000.0, (e.nEnd - e.nStart) / 1000.0);
+			}
+		}
+		fprintf(f, "\n]}\n");
+
+		bool bOk = ferror(f) == 0;
+		fclose(f);
+		return bOk;
+	}
+
+private:
+	// An sEvent as it sits in a ring, see Record()
+	struct sSlot
+	{
+		std::atomic<const char*> sName{ nullptr };
+		std::atomic<uint64_t> nStart{ 0 };
+		std::atomic<uint64_t> nEnd{ 0 };
+	};
+
+	struct sRing
+	{
+		std::atomic<uint64_t> nHead{ 0 };
+		std::atomic<const char*> sName{ "Thread" };
+		sSlot events[nRingSize];
+	};
+
+	// Rings outlive their threads, so zones from threads that have finished
+	// are still saved
+	struct sRegistry
+	{
+		std::mutex mux;
+		std::vector<std::unique_ptr<sRing>> vecRings;
+	};
+
+	static sRegistry &Registry()
+	{
+		static sRegistry registry;
+		return registry;
+	}
+
+	static sRing &ThreadRing()
+	{
+		thread_local sRing *pRing = nullptr;
+		if (pRing == nullptr)
+		{
+			std::lock_guard<std::mutex> lock(Registry().mux);
+			Registry().vecRings.push_back(std::make_unique<sRing>());
+			pRing = Registry().vecRings.back().get();
+		}
+		return *pRing;
+	}
+};
+
+class olcTraceZone
+{
+public:
+	explicit olcTraceZone(const char *sName) : sName(sName), nStart(olcTrace::Now())
+	{
+	}
+
+	~olcTraceZone()
+	{
+		End();
+	}
+
+	void End()
+	{
+		if (sName != nullptr)
+			olcTrace::Record(sName, nStart, olcTrace::Now());
+		sName = nullptr;
+	}
+
+private:
+	const char *sName;
+	uint64_t nStart;
+};
+
+#define OLC_TRACE_JOIN2(a, b) a##b
+#define OLC_TRACE_JOIN(a, b) OLC_TRACE_JOIN2(a, b)
+#define OLC_TRACE_ZONE(name) olcTraceZone OLC_TRACE_JOIN(olcTraceZone_, __LINE__)(name)
+#define OLC_TRACE_ZONE_NAMED(var, name) olcTraceZone var(name)
+#define OLC_TRACE_ZONE_END(var) var.End()
+#define OLC_TRACE_THREAD(name) olcTrace::NameThread(name)
+#else
+#define OLC_TRACE_ZONE(name)
+#define OLC_TRACE_ZONE_NAMED(var, name)
+#define OLC_TRACE_ZONE_END(var)
+#define OLC_TRACE_THREAD(name)
+#endif
+
+// A fixed size queue between two threads, one only pushing and the other only
+// popping. Each only ever writes its own index, so neither needs a lock, and
+// nothing is allocated once it exists. nCapacity must be a power of two.
+template <typename T, uint32_t nCapacity>
+class olcSpscQueue
+{
+public:
+	// Fails when the other thread has fallen nCapacity items behind
+	bool Push(const T &item)
+	{
+		uint32_t nTail = m_nTail.load(std::memory_order_relaxed);
+		if (nTail - m_nHead.load(std::memory_order_acquire) == nCapacity)
+			return false;
+		m_items[nTail & (nCapacity - 1)] = item;
+		m_nTail.store(nTail + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Pop(T &item)
+	{
+		uint32_t nHead = m_nHead.load(std::memory_order_relaxed);
+		if (nHead == m_nTail.load(std::memory_order_acquire))
+			return false;
+		item = m_items[nHead & (nCapacity - 1)];
+		m_nHead.store(nHead + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	static_assert((nCapacity & (nCapacity - 1)) == 0, "olcSpscQueue capacity must be a power of two");
+
+	T m_items[nCapacity];
+	alignas(64) std::atomic<uint32_t> m_nHead{ 0 };		// Next to pop, only the popping thread writes it
+	alignas(64) std::atomic<uint32_t> m_nTail{ 0 };		// Next to push, only the pushing thread writes it
+};
+
+// Keyboard and mouse input, as it happened, on its way from the engine's input
+// thread to the game thread
+struct olcInputEvent
+{
+	enum { KEY, MOUSE_BUTTON, MOUSE_MOVE, FOCUS };
+
+	uint8_t nType;
+	bool bDown;			// Key or button went down, or the focus came in
+	uint16_t nCode;		// Virtual key code, or mouse button 0 to 4
+	int16_t x, y;		// Mouse position, in screen cells
+	uint64_t nTime;		// When it was read, steady_clock nanoseconds
+};
+
+class olcInputQueue : public olcSpscQueue<olcInputEvent, 1024>
+{
+public:
+	static uint64_t Now()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+};
+
+// Screen recordings. A recording is a header followed by one record per frame:
+//
+//	header	"OLCR", uint32 version, int32 width, int32 height
+//	frame	uint8 type (0 keyframe, 1 delta), uint32 payload bytes,
+//			double seconds since the first frame, payload
+//
+// The payload walks the cells in order as a list of ops. Each op starts with
+// a varint whose low two bits are the op and the rest a cell count:
+//
+//	0 skip	cells unchanged from the previous frame (deltas only)
+//	1 run	one value, repeated for all the cells
+//	2 copy	one value per cell
+//
+// A value is a varint index into a table of the cell values seen so far. The
+// index one past the end adds a new value, and is followed by its uint16 glyph
+// and uint16 attributes. The table is emptied at each keyframe, so decoding
+// can start from any keyframe. Frames mostly use a handful of values, so an
+// index is usually a byte, and a cell that did not change costs nothing.
+class olcRecordingWriter
+{
+public:
+	static const uint32_t nVersion = 1;
+	static const int nKeyframeInterval = 300;
+
+	~olcRecordingWriter()
+	{
+		Close();
+	}
+
+	bool Open(const std::wstring &sFile, int nWidth, int nHeight)
+	{
+		Close();
+		_wfopen_s(&m_file, sFile.c_str(), L"wb");
+		if (m_file == nullptr)
+			return false;
+
+		m_nWidth = nWidth;
+		m_nHeight = nHeight;
+		m_nFrames = 0;
+		m_nBytes = 0;
+		m_vecPrev.assign(nWidth * nHeight, 0);
+		m_vecCur.resize(nWidth * nHeight);
+
+		int32_t header[4] = { 0, (int32_t)nVersion, nWidth, nHeight };
+		memcpy(header, "OLCR", 4);
+		fwrite(header, sizeof(header), 1, m_file);
+		m_nBytes += sizeof(header);
+		return true;
+	}
+
+	void Close()
+	{
+		if (m_file != nullptr)
+			fclose(m_file);
+		m_file = nullptr;
+	}
+
+	bool IsOpen() const { return m_file != nullptr; }
+	uint64_t Frames() const { return m_nFrames; }
+	uint64_t Bytes() const { return m_nBytes; }
+
+	// fTime is any clock in seconds; the file stores it relative to the first frame
+	bool Write(const CHAR_INFO *pScreen, double fTime)
+	{
+		if (m_file == nullptr)
+			return false;
+
+		int nCells = m_nWidth * m_nHeight;
+		for (int i = 0; i < nCells; i++)
+			m_vecCur[i] = (uint32_t)(uint16_t)pScreen[i].Char.UnicodeChar | ((uint32_t)pScreen[i].Attributes << 16);
+
+		if (m_nFrames == 0)
+			m_fStartTime = fTime;
+
+		bool bKey = m_nFrames % nKeyframeInterval == 0;
+		if (bKey)
+			m_mapValues.clear();
+
+		m_vecPayload.clear();
+		int i = 0;
+		while (i < nCells)
+		{
+			if (!bKey && m_vecCur[i] == m_vecPrev[i])
+			{
+				int j = i + 1;
+				while (j < nCells && m_vecCur[j] == m_vecPrev[j])
+					j++;
+				PutVarint(((uint32_t)(j - i) << 2) | 0);
+				i = j;
+				continue;
+			}
+
+			int nRun = RunLength(i, nCells);
+			if (nRun >= 3)
+			{
+				PutVarint(((uint32_t)nRun << 2) | 1);
+				PutValue(m_vecCur[i]);
+				i += nRun;
+				continue;
+			}
+
+			// Copy changed cells up to the next unchanged cell or run
+			int j = i + 1;
+			while (j < nCells && (bKey || m_vecCur[j] != m_vecPrev[j]) && RunLength(j, (std::min)(j + 3, nCells)) < 3)
+				j++;
+			PutVarint(((uint32_t)(j - i) << 2) | 2);
+			for (; i < j; i++)
+				PutValue(m_vecCur[i]);
+		}
+
+		uint8_t nType = bKey ? 0 : 1;
+		uint32_t nPayload = (uint32_t)m_vecPayload.size();
+		double fFrameTime = fTime - m_fStartTime;
+		fwrite(&nType, sizeof(nType), 1, m_file);
+		fwrite(&nPayload, sizeof(nPayload), 1, m_file);
+		fwrite(&fFrameTime, sizeof(fFrameTime), 1, m_file);
+		fwrite(m_vecPayload.data(), 1, nPayload, m_file);
+		m_nBytes += sizeof(nType) + sizeof(nPayload) + sizeof(fFrameTime) + nPayload;
+
+		m_vecPrev.swap(m_vecCur);
+		m_nFrames++;
+		return ferror(m_file) == 0;
+	}
+
+private:
+	int RunLength(int i, int nEnd) const
+	{
+		int j = i + 1;
+		while (j < nEnd && m_vecCur[j] == m_vecCur[i])
+			j++;
+		return j - i;
+	}
+
+	void PutVarint(uint32_t n)
+	{
+		while (n >= 0x80)
+		{
+			m_vecPayload.push_back((uint8_t)(n | 0x80));
+			n >>= 7;
+		}
+		m_vecPayload.push_back((uint8_t)n);
+	}
+
+	void PutValue(uint32_t nValue)
+	{
+		auto it = m_mapValues.find(nValue);
+		if (it != m_mapValues.end())
+		{
+			PutVarint(it->second);
+			return;
+		}
+
+		uint32_t nIndex = (uint32_t)m_mapValues.size();
+		m_mapValues.emplace(nValue, nIndex);
+		PutVarint(nIndex);
+		for (int b = 0; b < 4; b++)
+			m_vecPayload.push_back((uint8_t)(nValue >> (8 * b)));
+	}
+
+	FILE *m_file = nullptr;
+	int m_nWidth = 0;
+	int m_nHeight = 0;
+	uint64_t m_nFrames = 0;
+	uint64_t m_nBytes = 0;
+	double m_fStartTime = 0.0;
+	std::vector<uint32_t> m_vecPrev;
+	std::vector<uint32_t> m_vecCur;
+	std::vector<uint8_t> m_vecPayload;
+	std::unordered_map<uint32_t, uint32_t> m_mapValues;
+};
+
+// Reads recordings made by olcRecordingWriter. Opening one indexes all its
+// frames, after which any frame can be decoded, quickest in order.
+class olcRecordingReader
+{
+public:
+	~olcRecordingReader()
+	{
+		if (m_file != nullptr)
+			fclose(m_file);
+	}
+
+	bool Open(const std::wstring &sFile)
+	{
+		_wfopen_s(&m_file, sFile.c_str(), L"rb");
+		if (m_file == nullptr)
+			return false;
+
+		int32_t header[4];
+		if (fread(header, sizeof(header), 1, m_file) != 1 || memcmp(header, "OLCR", 4) != 0 ||
+			header[1] != (int32_t)olcRecordingWriter::nVersion || header[2] <= 0 || header[3] <= 0)
+			return false;
+
+		m_nWidth = header[2];
+		m_nHeight = header[3];
+		m_vecCells.assign(m_nWidth * m_nHeight, 0);
+
+		int64_t nFirst = Tell(m_file);
+		Seek(m_file, 0, SEEK_END);
+		int64_t nFileBytes = Tell(m_file);
+		Seek(m_file, nFirst, SEEK_SET);
+
+		// A recording cut off part way through a frame just ends at the frame before
+		sFrame frame;
+		uint8_t nType;
+		while (fread(&nType, sizeof(nType), 1, m_file) == 1 &&
+			fread(&frame.nBytes, sizeof(frame.nBytes), 1, m_file) == 1 &&
+			fread(&frame.fTime, sizeof(frame.fTime), 1, m_file) == 1)
+		{
+			frame.bKey = nType == 0;
+			frame.nOffset = Tell(m_file);
+			if (m_vecFrames.empty() && !frame.bKey)
+				return false;
+			if (frame.nOffset + frame.nBytes > nFileBytes || !Seek(m_file, frame.nOffset + frame.nBytes, SEEK_SET))
+				break;
+			m_vecFrames.push_back(frame);
+		}
+		return !m_vecFrames.empty();
+	}
+
+	int Width() const { return m_nWidth; }
+	int Height() const { return m_nHeight; }
+	size_t FrameCount() const { return m_vecFrames.size(); }
+	double FrameTime(size_t n) const { return m_vecFrames[n].fTime; }
+
+	// Decodes frame n into a screen buffer of Width() by Height() cells. Going
+	// anywhere but forwards one frame starts again from the keyframe before it.
+	bool ReadFrame(size_t n, CHAR_INFO *pScreen)
+	{
+		if (n >= m_vecFrames.size())
+			return false;
+
+		size_t nFrom = n;
+		if (n != m_nNext)
+			while (!m_vecFrames[nFrom].bKey)
+				nFrom--;
+		m_nNext = nFrom;
+
+		for (; m_nNext <= n; m_nNext++)
+			if (!DecodeFrame(m_vecFrames[m_nNext]))
+			{
+				m_nNext = m_vecFrames.size();
+				return false;
+			}
+
+		for (int i = 0; i < m_nWidth * m_nHeight; i++)
+		{
+			pScreen[i].Char.UnicodeChar = (wchar_t)(m_vecCells[i] & 0xFFFF);
+			pScreen[i].Attributes = (unsigned short)(m_vecCells[i] >> 16);
+		}
+		return true;
+	}
+
+private:
+	struct sFrame
+	{
+		int64_t nOffset;
+		uint32_t nBytes;
+		double fTime;
+		bool bKey;
+	};
+
+	bool DecodeFrame(const sFrame &frame)
+	{
+		m_vecPayload.resize(frame.nBytes);
+		if (!Seek(m_file, frame.nOffset, SEEK_SET) || fread(m_vecPayload.data(), 1, frame.nBytes, m_file) != frame.nBytes)
+			return false;
+
+		if (frame.bKey)
+			m_vecValues.clear();
+
+		const uint8_t *p = m_vecPayload.data(), *pEnd = p + frame.nBytes;
+		size_t nCells = m_vecCells.size(), i = 0;
+		uint32_t nValue;
+		while (p < pEnd)
+		{
+			uint32_t nOp;
+			if (!GetVarint(p, pEnd, nOp) || i + (nOp >> 2) > nCells)
+				return false;
+
+			size_t nCount = nOp >> 2;
+			switch (nOp & 3)
+			{
+			case 0:
+				break;
+
+			case 1:
+				if (!GetValue(p, pEnd, nValue))
+					return false;
+				std::fill(m_vecCells.begin() + i, m_vecCells.begin() + i + nCount, nValue);
+				break;
+
+			case 2:
+				for (size_t c = 0; c < nCount; c++)
+				{
+					if (!GetValue(p, pEnd, nValue))
+						return false;
+					m_vecCells[i + c] = nValue;
+				}
+				break;
+
+			default:
+				return false;
+			}
+			i += nCount;
+		}
+		return i == nCells;
+	}
+
+	// Recordings easily outgrow a long offset on Windows
+	static int64_t Tell(FILE *f)
+	{
+#ifdef _WIN32
+		return _ftelli64(f);
+#else
+		return ftello(f);
+#endif
+	}
+
+	static bool Seek(FILE *f, int64_t nOffset, int nOrigin)
+	{
+#ifdef _WIN32
+		return _fseeki64(f, nOffset, nOrigin) == 0;
+#else
+		return fseeko(f, nOffset, nOrigin) == 0;
+#endif
+	}
+
+	static bool GetVarint(const uint8_t *&p, const uint8_t *pEnd, uint32_t &n)
+	{
+		n = 0;
+		for (int nShift = 0; p < pEnd && nShift < 32; nShift += 7)
+		{
+			uint8_t b = *p++;
+			n |= (uint32_t)(b & 0x7F) << nShift;
+			if (!(b & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	bool GetValue(const uint8_t *&p, const uint8_t *pEnd, uint32_t &nValue)
+	{
+		uint32_t nIndex;
+		if (!GetVarint(p, pEnd, nIndex) || nIndex > m_vecValues.size())
+			return false;
+
+		if (nIndex == m_vecValues.size())
+		{
+			if (pEnd - p < 4)
+				return false;
+			nValue = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+			p += 4;
+			m_vecValues.push_back(nValue);
+		}
+		else
+			nValue = m_vecValues[nIndex];
+		return true;
+	}
+
+	FILE *m_file = nullptr;
+	int m_nWidth = 0;
+	int m_nHeight = 0;
+	size_t m_nNext = 0;
+	std::vector<sFrame> m_vecFrames;
+	std::vector<uint32_t> m_vecCells;
+	std::vector<uint32_t> m_vecValues;
+	std::vector<uint8_t> m_vecPayload;
+};
+
 class olcConsoleGameEngine
 {
 public:
@@ -324,12 +1041,14 @@ public:
 		m_nScreenWidth = 80;
 		m_nScreenHeight = 30;
 
+#ifdef _WIN32
 		m_hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
 		m_hConsoleIn = GetStdHandle(STD_INPUT_HANDLE);
+		m_hOriginalConsole = m_hConsole;
+#endif
 
-		std::memset(m_keyNewState, 0, 256 * sizeof(short));
-		std::memset(m_keyOldState, 0, 256 * sizeof(short));
 		std::memset(m_keys, 0, 256 * sizeof(sKeyState));
+		std::memset(m_mouse, 0, 5 * sizeof(sKeyState));
 		m_mousePosX = 0;
 		m_mousePosY = 0;
 
@@ -343,8 +1062,41 @@ public:
 		m_bEnableSound = true;
 	}
 
+	// By default onUserSoundBlock() and onUserFilterBlock() call
+	// onUserSoundSample() and onUserSoundFilter() for every sample. An app
+	// that overrides neither per-sample hook can switch those calls off, for
+	// the generated sound and the filter separately. Call before Start().
+	void SetPerSampleSoundHooks(bool bSample, bool bFilter)
+	{
+		m_bUserSoundSample = bSample;
+		m_bUserSoundFilter = bFilter;
+	}
+
+	// Lets the span and shape drawing functions write the screen buffer
+	// directly rather than a cell at a time through Draw(). Only for apps that
+	// do not override Draw(), or do not need it to see those cells.
+	void EnableSpanDrawing()
+	{
+		m_bDrawSpans = true;
+	}
+
+	// Allocates a per-cell depth buffer alongside the screen buffer, for use with
+	// ClearDepth() and FillTriangleDepth(). Call after ConstructConsole().
+	void EnableDepthBuffer()
+	{
+		if (m_bufDepth == nullptr && m_bufScreen != nullptr)
+		{
+			m_bufDepth = new float[m_nScreenWidth*m_nScreenHeight];
+			ClearDepth();
+		}
+	}
+
 	int ConstructConsole(int width, int height, int fontw, int fonth)
 	{
+#ifndef _WIN32
+		(void)width; (void)height; (void)fontw; (void)fonth;
+		return Error(L"No console on this platform, use ConstructHeadless()");
+#else
 		if (m_hConsole == INVALID_HANDLE_VALUE)
 			return Error(L"Bad Handle");
 
@@ -425,14 +1177,165 @@ public:
 
 		SetConsoleCtrlHandler((PHANDLER_ROUTINE)CloseHandler, TRUE);
 		return 1;
+#endif
 	}
 
-	virtual void Draw(int x, int y, short c = 0x2588, short col = 0x000F)
+	// The headless target has no console, input or audio device - the screen
+	// is just a buffer in memory. Start() then runs exactly nFrames frames,
+	// each told fTimeStep seconds have passed, and returns. Afterwards the
+	// last frame can be written out with SaveScreen(). Works on any platform.
+	int ConstructHeadless(int width, int height, int nFrames, float fTimeStep = 1.0f / 60.0f)
 	{
-		if (x >= 0 && x < m_nScreenWidth && y >= 0 && y < m_nScreenHeight)
-		{
-			m_bufScreen[y * m_nScreenWidth + x].Char.UnicodeChar = c;
-			m_bufScreen[y * m_nScreenWidth + x].Attributes = col;
+		if (width <= 0 || height <= 0 || nFrames <= 0)
+			return Error(L"Bad headless screen size or frame count");
+
+		m_nScreenWidth = width;
+		m_nScreenHeight = height;
+		m_bHeadless = true;
+		m_nHeadlessFrames = nFrames;
+		m_fHeadlessTimeStep = fTimeStep;
+
+		m_bufScreen = new CHAR_INFO[m_nScreenWidth*m_nScreenHeight];
+		memset(m_bufScreen, 0, sizeof(CHAR_INFO) * m_nScreenWidth * m_nScreenHeight);
+		return 1;
+	}
+
+	// Writes the screen buffer out in the same format as olcSprite::Save(), so
+	// it can be loaded back in as a sprite, or compared against another run
+	bool SaveScreen(const std::wstring &sFile)
+	{
+		if (m_bufScreen == nullptr)
+			return false;
+
+		FILE *f = nullptr;
+		_wfopen_s(&f, sFile.c_str(), L"wb");
+		if (f == nullptr)
+			return false;
+
+		int nCells = m_nScreenWidth * m_nScreenHeight;
+		std::vector<short> vecColours(nCells), vecGlyphs(nCells);
+		for (int i = 0; i < nCells; i++)
+		{
+			vecColours[i] = (short)m_bufScreen[i].Attributes;
+			vecGlyphs[i] = (short)m_bufScreen[i].Char.UnicodeChar;
+		}
+
+		fwrite(&m_nScreenWidth, sizeof(int), 1, f);
+		fwrite(&m_nScreenHeight, sizeof(int), 1, f);
+		fwrite(vecColours.data(), sizeof(short), nCells, f);
+		fwrite(vecGlyphs.data(), sizeof(short), nCells, f);
+
+		bool bOk = ferror(f) == 0;
+		fclose(f);
+		return bOk;
+	}
+
+	bool IsHeadless() { return m_bHeadless; }
+
+	// Draws to a VT/ANSI terminal instead of the Windows console, e.g. a Linux
+	// terminal over SSH. Every frame only the cells that changed since the
+	// last one are sent, all in a single write. POSIX only for now. Keys and
+	// the mouse are read from standard input when it is the terminal too.
+	// Ctrl+C ends the application normally.
+	int ConstructTerminal(int width, int height)
+	{
+#ifdef _WIN32
+		(void)width; (void)height;
+		return Error(L"Use ConstructConsole() on Windows");
+#else
+		if (!isatty(STDOUT_FILENO))
+			return Error(L"Standard output is not a terminal");
+
+		// One cell per character, so the screen has to fit, or rows wrap and
+		// scroll the frame apart. A terminal that cannot say is trusted.
+		winsize ws;
+		if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0)
+		{
+			if (height > ws.ws_row)
+				return Error(L"Screen Height Too Big For Terminal");
+			if (width > ws.ws_col)
+				return Error(L"Screen Width Too Big For Terminal");
+		}
+
+		m_nScreenWidth = width;
+		m_nScreenHeight = height;
+		m_bTerminal = true;
+
+		m_bufScreen = new CHAR_INFO[m_nScreenWidth*m_nScreenHeight];
+		memset(m_bufScreen, 0, sizeof(CHAR_INFO) * m_nScreenWidth * m_nScreenHeight);
+		m_bufPresented = new CHAR_INFO[m_nScreenWidth*m_nScreenHeight];
+		memset(m_bufPresented, 0, sizeof(CHAR_INFO) * m_nScreenWidth * m_nScreenHeight);
+
+		// Enough for a full redraw of a busy frame without growing
+		m_sTerminalFrame.reserve(m_nScreenWidth * m_nScreenHeight * 8);
+
+		signal(SIGINT, TerminalSignalHandler);
+		signal(SIGTERM, TerminalSignalHandler);
+
+		// Alternate screen, so the shell's contents come back afterwards, with
+		// the cursor hidden
+		const char *sEnter = "\x1b[?1049h\x1b[?25l\x1b[0m\x1b[2J";
+		if (!WriteTerminal(sEnter, strlen(sEnter)))
+			return Error(L"Cannot write to the terminal");
+
+		// Input in raw mode, though Ctrl+C still raises SIGINT. The terminal
+		// reports the mouse in SGR encoding, focus changes, and if it speaks
+		// the kitty keyboard protocol, key releases too.
+		if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &m_termiosOriginal) == 0)
+		{
+			termios raw = m_termiosOriginal;
+			raw.c_iflag &= ~(IXON | ICRNL);
+			raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+			raw.c_cc[VMIN] = 1;
+			raw.c_cc[VTIME] = 0;
+			if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == 0)
+			{
+				m_bTerminalInput = true;
+				const char *sInputOn = "\x1b[?1003h\x1b[?1006h\x1b[?1004h\x1b[>11u";
+				WriteTerminal(sInputOn, strlen(sInputOn));
+			}
+		}
+		return 1;
+#endif
+	}
+
+	// Saves every frame from here on to sFile, whatever it is presented on, as
+	// an olcRecordingWriter recording. Call after constructing the screen.
+	bool StartRecording(const std::wstring &sFile)
+	{
+		if (m_bufScreen == nullptr)
+			return false;
+		return m_recorder.Open(sFile, m_nScreenWidth, m_nScreenHeight);
+	}
+
+	void StopRecording()
+	{
+		m_recorder.Close();
+	}
+
+	// Saves the trace zones recorded so far as Chrome trace JSON, see olcTrace.
+	// Fails if the engine was built without OLC_TRACE.
+	bool SaveTrace(const std::wstring &sFile)
+	{
+#ifdef OLC_TRACE
+		return olcTrace::Save(sFile);
+#else
+		(void)sFile;
+		return false;
+#endif
+	}
+
+	// Size of the last frame sent to the terminal, and the average over all of
+	// them so far, in bytes. Both zero when not drawing to a terminal.
+	size_t PresentedBytes() { return (size_t)m_nTerminalBytes; }
+	double PresentedBytesAverage() { return m_nTerminalFrames ? (double)m_nTerminalBytesTotal / (double)m_nTerminalFrames : 0.0; }
+
+	virtual void Draw(int x, int y, short c = 0x2588, short col = 0x000F)
+	{
+		if (x >= 0 && x < m_nScreenWidth && y >= 0 && y < m_nScreenHeight)
+		{
+			m_bufScreen[y * m_nScreenWidth + x].Char.UnicodeChar = c;
+			m_bufScreen[y * m_nScreenWidth + x].Attributes = col;
 		}
 	}
 
@@ -440,9 +1343,8 @@ public:
 	{
 		Clip(x1, y1);
 		Clip(x2, y2);
-		for (int x = x1; x < x2; x++)
-			for (int y = y1; y < y2; y++)
-				Draw(x, y, c, col);
+		for (int y = y1; y < y2; y++)
+			DrawSpan(x1, x2, y, c, col);
 	}
 
 	void DrawString(int x, int y, std::wstring c, short col = 0x000F)
@@ -466,6 +1368,90 @@ public:
 		}
 	}
 
+	// Cells a drawing call may touch: [x1, x2) by [y1, y2). The overloads taking
+	// one never write outside the rectangle, so different threads can draw into
+	// different parts of the screen at once.
+	struct sRect
+	{
+		int x1, y1, x2, y2;
+	};
+
+	sRect ScreenRect()
+	{
+		return { 0, 0, m_nScreenWidth, m_nScreenHeight };
+	}
+
+	// Span API. Draws cells [x1, x2) of row y, clipped once. The shape drawing
+	// functions are all built on these. By default each cell still goes through
+	// Draw(), so an overridden Draw() sees everything drawn; after
+	// EnableSpanDrawing() spans are written straight into the screen buffer,
+	// with no bounds check or virtual call per cell.
+	void DrawSpan(int x1, int x2, int y, short c, short col, const sRect &clip)
+	{
+		if (y < clip.y1 || y >= clip.y2) return;
+		if (x1 < clip.x1) x1 = clip.x1;
+		if (x2 > clip.x2) x2 = clip.x2;
+		if (x1 >= x2) return;
+
+		if (!m_bDrawSpans)
+		{
+			for (int x = x1; x < x2; x++)
+				Draw(x, y, c, col);
+			return;
+		}
+
+		CHAR_INFO *pCell = &m_bufScreen[y * m_nScreenWidth + x1];
+		for (int x = x1; x < x2; x++, pCell++)
+		{
+			pCell->Char.UnicodeChar = c;
+			pCell->Attributes = col;
+		}
+	}
+
+	void DrawSpan(int x1, int x2, int y, short c = 0x2588, short col = 0x000F)
+	{
+		DrawSpan(x1, x2, y, c, col, ScreenRect());
+	}
+
+	// Copies n cells of glyphs and colours into row y starting at x, leaving
+	// the cells where the glyph is L' ' alone - a row of a sprite
+	void DrawSpan(int x, int y, const short *pGlyphs, const short *pColours, int n, const sRect &clip)
+	{
+		if (y < clip.y1 || y >= clip.y2) return;
+		int i1 = (std::max)(0, clip.x1 - x);
+		int i2 = (std::min)(n, clip.x2 - x);
+		if (i1 >= i2) return;
+
+		if (!m_bDrawSpans)
+		{
+			for (int i = i1; i < i2; i++)
+				if (pGlyphs[i] != L' ')
+					Draw(x + i, y, pGlyphs[i], pColours[i]);
+			return;
+		}
+
+		CHAR_INFO *pCell = &m_bufScreen[y * m_nScreenWidth + x + i1];
+		for (int i = i1; i < i2; i++, pCell++)
+		{
+			if (pGlyphs[i] != L' ')
+			{
+				pCell->Char.UnicodeChar = pGlyphs[i];
+				pCell->Attributes = pColours[i];
+			}
+		}
+	}
+
+	// Clears part of the screen, and of the depth buffer if there is one
+	void ClearRect(const sRect &rect, short c = 0x2588, short col = 0x000F)
+	{
+		for (int y = rect.y1; y < rect.y2; y++)
+		{
+			DrawSpan(rect.x1, rect.x2, y, c, col, rect);
+			if (m_bufDepth != nullptr)
+				std::fill(&m_bufDepth[y * m_nScreenWidth + rect.x1], &m_bufDepth[y * m_nScreenWidth + rect.x2], std::numeric_limits<float>::infinity());
+		}
+	}
+
 	void Clip(int &x, int &y)
 	{
 		if (x < 0) x = 0;
@@ -475,6 +1461,34 @@ public:
 	}
 
 	void DrawLine(int x1, int y1, int x2, int y2, short c = 0x2588, short col = 0x000F)
+	{
+		DrawLine(x1, y1, x2, y2, c, col, ScreenRect());
+	}
+
+	// As above, but only touching cells inside clip
+	void DrawLine(int x1, int y1, int x2, int y2, short c, short col, const sRect &clip)
+	{
+		// Cells come one at a time, run the ones next to each other on a row
+		// together into a span
+		int nRunX1 = 0, nRunX2 = 0, nRunY = 0;
+		DrawLinePoints(x1, y1, x2, y2, [&](int x, int y)
+		{
+			if (y == nRunY && x == nRunX2)
+			{
+				nRunX2++;
+				return;
+			}
+			DrawSpan(nRunX1, nRunX2, nRunY, c, col, clip);
+			nRunX1 = x;
+			nRunX2 = x + 1;
+			nRunY = y;
+		});
+		DrawSpan(nRunX1, nRunX2, nRunY, c, col, clip);
+	}
+
+	// The line walker behind DrawLine - calls plot(x, y) for each cell on the line
+	template<typename F>
+	void DrawLinePoints(int x1, int y1, int x2, int y2, F plot)
 	{
 		int x, y, dx, dy, dx1, dy1, px, py, xe, ye, i;
 		dx = x2 - x1; dy = y2 - y1;
@@ -487,7 +1501,7 @@ public:
 			else
 				{ x = x2; y = y2; xe = x1;}
 
-			Draw(x, y, c, col);
+			plot(x, y);
 			
 			for (i = 0; x<xe; i++)
 			{
@@ -499,7 +1513,7 @@ public:
 					if ((dx<0 && dy<0) || (dx>0 && dy>0)) y = y + 1; else y = y - 1;
 					px = px + 2 * (dy1 - dx1);
 				}
-				Draw(x, y, c, col);
+				plot(x, y);
 			}
 		}
 		else
@@ -509,7 +1523,7 @@ public:
 			else
 				{ x = x2; y = y2; ye = y1; }
 
-			Draw(x, y, c, col);
+			plot(x, y);
 
 			for (i = 0; y<ye; i++)
 			{
@@ -521,7 +1535,7 @@ public:
 					if ((dx<0 && dy<0) || (dx>0 && dy>0)) x = x + 1; else x = x - 1;
 					py = py + 2 * (dx1 - dy1);
 				}
-				Draw(x, y, c, col);
+				plot(x, y);
 			}
 		}
 	}
@@ -533,12 +1547,265 @@ public:
 		DrawLine(x3, y3, x1, y1, c, col);
 	}
 
-	// https://www.avrfreaks.net/sites/default/files/triangles.c
+	// As above, but only touching cells inside clip
+	void DrawTriangle(int x1, int y1, int x2, int y2, int x3, int y3, short c, short col, const sRect &clip)
+	{
+		DrawLine(x1, y1, x2, y2, c, col, clip);
+		DrawLine(x2, y2, x3, y3, c, col, clip);
+		DrawLine(x3, y3, x1, y1, c, col, clip);
+	}
+
 	void FillTriangle(int x1, int y1, int x2, int y2, int x3, int y3, short c = 0x2588, short col = 0x000F)
+	{
+		FillTriangle(x1, y1, x2, y2, x3, y3, c, col, ScreenRect());
+	}
+
+	// As above, but only touching cells inside clip
+	void FillTriangle(int x1, int y1, int x2, int y2, int x3, int y3, short c, short col, const sRect &clip)
+	{
+		// Triangles may reach well off screen, DrawSpan only visits the part inside clip
+		FillTriangleSpans(x1, y1, x2, y2, x3, y3, [&](int sx, int ex, int ny)
+		{
+			DrawSpan(sx, ex + 1, ny, c, col, clip);
+		});
+	}
+
+	// Alternative to FillTriangle using half-space edge functions. Vertices are
+	// snapped to 1/16 of a cell and a cell is filled if its centre is inside the
+	// triangle. Centres exactly on an edge follow the top-left rule, so two
+	// triangles sharing an edge never both fill, or both miss, a cell along it.
+	// Rows are tested four cells at a time with SSE2 where there is one, and
+	// written with DrawSpan.
+	void FillTriangleHalfSpace(float x1, float y1, float x2, float y2, float x3, float y3, short c = 0x2588, short col = 0x000F)
+	{
+		FillTriangleHalfSpace(x1, y1, x2, y2, x3, y3, c, col, ScreenRect());
+	}
+
+	// As above, but only touching cells inside clip
+	void FillTriangleHalfSpace(float x1, float y1, float x2, float y2, float x3, float y3, short c, short col, const sRect &clip)
+	{
+		FillTriangleHalfSpaceSpans(x1, y1, x2, y2, x3, y3, clip, [&](int sx, int ex, int y)
+		{
+			DrawSpan(sx, ex, y, c, col, clip);
+		});
+	}
+
+	// As above, but with a shade s interpolated across the triangle and cells
+	// taken from a ramp of them by DitherRamp(). Like DrawSpan(), cells go
+	// through Draw() unless EnableSpanDrawing() has been called.
+	void FillTriangleHalfSpace(float x1, float y1, float s1, float x2, float y2, float s2, float x3, float y3, float s3,
+		const CHAR_INFO *pRamp, int nRamp, const sRect &clip)
+	{
+		float area = (x2 - x1) * (y3 - y1) - (y2 - y1) * (x3 - x1);
+		if (area == 0.0f) return;
+		float dsdx = ((s2 - s1) * (y3 - y1) - (s3 - s1) * (y2 - y1)) / area;
+		float dsdy = ((s3 - s1) * (x2 - x1) - (s2 - s1) * (x3 - x1)) / area;
+
+		// Cells are written directly, so clip has to stay on the screen
+		sRect rect = { (std::max)(clip.x1, 0), (std::max)(clip.y1, 0),
+			(std::min)(clip.x2, m_nScreenWidth), (std::min)(clip.y2, m_nScreenHeight) };
+
+		FillTriangleHalfSpaceSpans(x1, y1, x2, y2, x3, y3, rect, [&](int sx, int ex, int y)
+		{
+			float sy = s1 + dsdy * ((float)y + 0.5f - y1);
+			if (!m_bDrawSpans)
+			{
+				for (int x = sx; x < ex; x++)
+				{
+					CHAR_INFO cell = DitherRamp(pRamp, nRamp, sy + dsdx * ((float)x + 0.5f - x1), x, y);
+					Draw(x, y, cell.Char.UnicodeChar, cell.Attributes);
+				}
+				return;
+			}
+
+			CHAR_INFO *pCell = &m_bufScreen[y * m_nScreenWidth + sx];
+			for (int x = sx; x < ex; x++, pCell++)
+				*pCell = DitherRamp(pRamp, nRamp, sy + dsdx * ((float)x + 0.5f - x1), x, y);
+		});
+	}
+
+	// Picks a cell from a ramp of nRamp of them, darkest first, for a shade s
+	// measured in ramp steps. The fraction of a step is turned into a pattern by
+	// a 4x4 Bayer matrix, so a gradient across a triangle has no hard bands.
+	static CHAR_INFO DitherRamp(const CHAR_INFO *pRamp, int nRamp, float s, int x, int y)
+	{
+		static const float fBayer[4][4] =
+		{
+			{  0.5f / 16.0f,  8.5f / 16.0f,  2.5f / 16.0f, 10.5f / 16.0f },
+			{ 12.5f / 16.0f,  4.5f / 16.0f, 14.5f / 16.0f,  6.5f / 16.0f },
+			{  3.5f / 16.0f, 11.5f / 16.0f,  1.5f / 16.0f,  9.5f / 16.0f },
+			{ 15.5f / 16.0f,  7.5f / 16.0f, 13.5f / 16.0f,  5.5f / 16.0f },
+		};
+		int i = (int)(std::max)(0.0f, s + fBayer[y & 3][x & 3]);
+		return pRamp[(std::min)(i, nRamp - 1)];
+	}
+
+	// The rasteriser behind FillTriangleHalfSpace - calls span(sx, ex, y) for
+	// each run of covered cells [sx, ex) on row y, all inside clip
+	template<typename F>
+	void FillTriangleHalfSpaceSpans(float x1, float y1, float x2, float y2, float x3, float y3, const sRect &clip, F span)
+	{
+		const int nSubBits = 4;
+		const int64_t nSub = 1 << nSubBits;
+
+		// Far enough out that the 64 bit edge functions below could overflow.
+		// Callers clip long before this.
+		const float fLimit = (float)(1 << 20);
+		if (!(fabsf(x1) < fLimit && fabsf(x2) < fLimit && fabsf(x3) < fLimit &&
+			fabsf(y1) < fLimit && fabsf(y2) < fLimit && fabsf(y3) < fLimit))
+			return;
+
+		int64_t vx[3] = { llroundf(x1 * nSub), llroundf(x2 * nSub), llroundf(x3 * nSub) };
+		int64_t vy[3] = { llroundf(y1 * nSub), llroundf(y2 * nSub), llroundf(y3 * nSub) };
+
+		// Twice the signed area - put the vertices in the order where it is positive
+		int64_t area = (vx[1] - vx[0]) * (vy[2] - vy[0]) - (vy[1] - vy[0]) * (vx[2] - vx[0]);
+		if (area == 0) return;
+		if (area < 0)
+		{
+			std::swap(vx[1], vx[2]);
+			std::swap(vy[1], vy[2]);
+		}
+
+		// Cells whose centre, at (x * nSub + nSub / 2), is inside the bounding
+		// box, clipped to clip
+		auto floorDiv = [](int64_t a, int64_t b) { return a >= 0 ? a / b : -((-a + b - 1) / b); };
+		int64_t minX = (std::min)(vx[0], (std::min)(vx[1], vx[2]));
+		int64_t maxX = (std::max)(vx[0], (std::max)(vx[1], vx[2]));
+		int64_t minY = (std::min)(vy[0], (std::min)(vy[1], vy[2]));
+		int64_t maxY = (std::max)(vy[0], (std::max)(vy[1], vy[2]));
+		int minx = (int)(std::max)((int64_t)clip.x1, floorDiv(minX - nSub / 2 + nSub - 1, nSub));
+		int maxx = (int)(std::min)((int64_t)clip.x2 - 1, floorDiv(maxX - nSub / 2, nSub));
+		int miny = (int)(std::max)((int64_t)clip.y1, floorDiv(minY - nSub / 2 + nSub - 1, nSub));
+		int maxy = (int)(std::min)((int64_t)clip.y2 - 1, floorDiv(maxY - nSub / 2, nSub));
+		if (minx > maxx || miny > maxy) return;
+
+		// Edge functions, E >= 0 inside. Edges that are not top or left edges are
+		// biased by one so a centre exactly on them counts as outside. Stepping a
+		// cell is exact in integers, so results do not depend on where clip is.
+		int64_t eRow[3], eStepX[3], eStepY[3];
+		for (int i = 0; i < 3; i++)
+		{
+			int j = (i + 1) % 3;
+			int64_t dx = vx[j] - vx[i];
+			int64_t dy = vy[j] - vy[i];
+			bool bTopLeft = dy < 0 || (dy == 0 && dx > 0);
+			int64_t px = (int64_t)minx * nSub + nSub / 2;
+			int64_t py = (int64_t)miny * nSub + nSub / 2;
+			eRow[i] = dx * (py - vy[i]) - dy * (px - vx[i]) - (bTopLeft ? 0 : 1);
+			eStepX[i] = -dy * nSub;
+			eStepY[i] = dx * nSub;
+		}
+
+		// A convex shape covers one unbroken run of each row. Walk the row until
+		// the run has started and then ended.
+		int nSpanX1, nSpanX2;
+
+#ifdef OLC_SSE2
+		// Four cells at a time in 32 bit lanes, as long as every value the
+		// edge functions take over the box (rounded up to whole groups of four)
+		// fits. E is linear, so checking the corners is enough.
+		const int64_t nLimit32 = (int64_t)1 << 30;
+		bool bFits = true;
+		int nGroups = (maxx - minx) / 4 + 1;
+		for (int i = 0; i < 3; i++)
+		{
+			int64_t eRight = eRow[i] + eStepX[i] * (nGroups * 4 - 1);
+			int64_t eDown = eStepY[i] * (maxy - miny);
+			for (int64_t e : { eRow[i], eRight, eRow[i] + eDown, eRight + eDown })
+				bFits = bFits && e > -nLimit32 && e < nLimit32;
+			bFits = bFits && llabs(eStepX[i] * 4) < nLimit32;
+		}
+
+		if (bFits)
+		{
+			// Lowest and highest set bit of a 4 bit mask
+			static const int8_t nLowBit[16] = { -1, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0 };
+			static const int8_t nHighBit[16] = { -1, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3 };
+
+			__m128i eLanes[3], eStep4[3];
+			for (int i = 0; i < 3; i++)
+			{
+				int s = (int)eStepX[i];
+				eLanes[i] = _mm_setr_epi32(0, s, 2 * s, 3 * s);
+				eStep4[i] = _mm_set1_epi32(4 * s);
+			}
+
+			for (int y = miny; y <= maxy; y++)
+			{
+				__m128i e0 = _mm_add_epi32(_mm_set1_epi32((int)eRow[0]), eLanes[0]);
+				__m128i e1 = _mm_add_epi32(_mm_set1_epi32((int)eRow[1]), eLanes[1]);
+				__m128i e2 = _mm_add_epi32(_mm_set1_epi32((int)eRow[2]), eLanes[2]);
+
+				nSpanX1 = nSpanX2 = -1;
+				for (int x = minx; x <= maxx; x += 4)
+				{
+					// A lane is inside if none of its edge functions has the sign bit set
+					__m128i eAny = _mm_or_si128(_mm_or_si128(e0, e1), e2);
+					int nMask = ~_mm_movemask_ps(_mm_castsi128_ps(eAny)) & 0xF;
+					if (maxx - x < 3)
+						nMask &= (1 << (maxx - x + 1)) - 1;
+
+					if (nMask != 0)
+					{
+						if (nSpanX1 < 0)
+							nSpanX1 = x + nLowBit[nMask];
+						nSpanX2 = x + nHighBit[nMask] + 1;
+						if (nHighBit[nMask] < 3)
+							break;
+					}
+					else if (nSpanX1 >= 0)
+						break;
+
+					e0 = _mm_add_epi32(e0, eStep4[0]);
+					e1 = _mm_add_epi32(e1, eStep4[1]);
+					e2 = _mm_add_epi32(e2, eStep4[2]);
+				}
+
+				if (nSpanX1 >= 0)
+					span(nSpanX1, nSpanX2, y);
+
+				for (int i = 0; i < 3; i++)
+					eRow[i] += eStepY[i];
+			}
+			return;
+		}
+#endif
+
+		for (int y = miny; y <= maxy; y++)
+		{
+			int64_t e[3] = { eRow[0], eRow[1], eRow[2] };
+			nSpanX1 = nSpanX2 = -1;
+			for (int x = minx; x <= maxx; x++)
+			{
+				if ((e[0] | e[1] | e[2]) >= 0)
+				{
+					if (nSpanX1 < 0)
+						nSpanX1 = x;
+					nSpanX2 = x + 1;
+				}
+				else if (nSpanX1 >= 0)
+					break;
+
+				for (int i = 0; i < 3; i++)
+					e[i] += eStepX[i];
+			}
+
+			if (nSpanX1 >= 0)
+				span(nSpanX1, nSpanX2, y);
+
+			for (int i = 0; i < 3; i++)
+				eRow[i] += eStepY[i];
+		}
+	}
+
+	// https://www.avrfreaks.net/sites/default/files/triangles.c
+	// The scan converter behind FillTriangle - calls drawline(sx, ex, y) for each span
+	template<typename F>
+	void FillTriangleSpans(int x1, int y1, int x2, int y2, int x3, int y3, F drawline)
 	{
 		auto SWAP = [](int &x, int &y) { int t = x; x = y; y = t; };
-		auto drawline = [&](int sx, int ex, int ny) { for (int i = sx; i <= ex; i++) Draw(i, ny, c, col); };
-		
+
 		int t1x, t2x, y, minx, maxx, t1xp, t2xp;
 		bool changed1 = false;
 		bool changed2 = false;
@@ -671,6 +1938,128 @@ public:
 		}
 	}
 
+	// Resets every cell of the depth buffer to "infinitely far away"
+	void ClearDepth()
+	{
+		if (m_bufDepth == nullptr)
+			return;
+		std::fill(m_bufDepth, m_bufDepth + m_nScreenWidth * m_nScreenHeight, std::numeric_limits<float>::infinity());
+	}
+
+	// Depth-tested triangle fill. Needs EnableDepthBuffer(). z is interpolated
+	// linearly across the triangle, so should be something that is linear in
+	// screen space (such as z/w after projection) - smaller is nearer. A cell is
+	// covered if its centre is inside the triangle, and is only drawn if it is
+	// nearer than what is already there. If outlineCol is not -1, the cells along
+	// the inside of each edge are drawn with a solid glyph in that colour, still
+	// depth tested, which gives the same look as DrawTriangle() over FillTriangle()
+	// without hidden edges showing through.
+	void FillTriangleDepth(float x1, float y1, float z1, float x2, float y2, float z2, float x3, float y3, float z3,
+		short c = 0x2588, short col = 0x000F, short outlineCol = -1)
+	{
+		FillTriangleDepth(x1, y1, z1, x2, y2, z2, x3, y3, z3, c, col, outlineCol, ScreenRect());
+	}
+
+	// As above, but only touching cells inside clip. Every cell is worked out on
+	// its own, so the result inside clip does not depend on where clip is.
+	void FillTriangleDepth(float x1, float y1, float z1, float x2, float y2, float z2, float x3, float y3, float z3,
+		short c, short col, short outlineCol, const sRect &clip)
+	{
+		CHAR_INFO fill;
+		fill.Char.UnicodeChar = c;
+		fill.Attributes = col;
+		FillTriangleDepthCells(x1, y1, z1, 0.0f, x2, y2, z2, 0.0f, x3, y3, z3, 0.0f, outlineCol, clip,
+			[&](int, int, float) { return fill; });
+	}
+
+	// As above, but with a shade s interpolated across the triangle like z, and
+	// cells taken from a ramp of them by DitherRamp()
+	void FillTriangleDepth(float x1, float y1, float z1, float s1, float x2, float y2, float z2, float s2,
+		float x3, float y3, float z3, float s3, const CHAR_INFO *pRamp, int nRamp, short outlineCol, const sRect &clip)
+	{
+		FillTriangleDepthCells(x1, y1, z1, s1, x2, y2, z2, s2, x3, y3, z3, s3, outlineCol, clip,
+			[&](int x, int y, float s) { return DitherRamp(pRamp, nRamp, s, x, y); });
+	}
+
+	// The rasteriser behind FillTriangleDepth - cell(x, y, s) gives what to draw
+	// in each covered cell that passes the depth test, outline aside
+	template<typename F>
+	void FillTriangleDepthCells(float x1, float y1, float z1, float s1, float x2, float y2, float z2, float s2,
+		float x3, float y3, float z3, float s3, short outlineCol, const sRect &clip, F cell)
+	{
+		if (m_bufDepth == nullptr)
+			return;
+
+		// Twice the signed area - put the vertices in counter-clockwise order
+		float area = (x2 - x1) * (y3 - y1) - (y2 - y1) * (x3 - x1);
+		if (area == 0.0f) return;
+		if (area < 0.0f)
+		{
+			std::swap(x2, x3); std::swap(y2, y3); std::swap(z2, z3); std::swap(s2, s3);
+			area = -area;
+		}
+
+		// Bounding box, clipped to clip
+		int minx = (std::max)(clip.x1, (int)floorf((std::min)(x1, (std::min)(x2, x3))));
+		int maxx = (std::min)(clip.x2 - 1, (int)ceilf((std::max)(x1, (std::max)(x2, x3))));
+		int miny = (std::max)(clip.y1, (int)floorf((std::min)(y1, (std::min)(y2, y3))));
+		int maxy = (std::min)(clip.y2 - 1, (int)ceilf((std::max)(y1, (std::max)(y2, y3))));
+		if (minx > maxx || miny > maxy) return;
+
+		// Edge functions, E(px, py) >= 0 on the inside of each edge
+		float ex[3] = { x2 - x1, x3 - x2, x1 - x3 };
+		float ey[3] = { y2 - y1, y3 - y2, y1 - y3 };
+		float ox[3] = { x1, x2, x3 };
+		float oy[3] = { y1, y2, y3 };
+
+		// Depth as a plane over the screen, from the barycentric weights
+		float dzdx = ((z2 - z1) * (y3 - y1) - (z3 - z1) * (y2 - y1)) / area;
+		float dzdy = ((z3 - z1) * (x2 - x1) - (z2 - z1) * (x3 - x1)) / area;
+		float dsdx = ((s2 - s1) * (y3 - y1) - (s3 - s1) * (y2 - y1)) / area;
+		float dsdy = ((s3 - s1) * (x2 - x1) - (s2 - s1) * (x3 - x1)) / area;
+
+		// An edge function divided by the larger of |dx| and |dy| is roughly the
+		// distance from that edge in cells. Cells within half a cell are the
+		// outline, so an edge shared by two triangles ends up one cell thick.
+		float edgeWidth[3];
+		for (int e = 0; e < 3; e++)
+			edgeWidth[e] = outlineCol == -1 ? 0.0f : 0.5f * (std::max)(fabsf(ex[e]), fabsf(ey[e]));
+
+		for (int y = miny; y <= maxy; y++)
+		{
+			float py = (float)y + 0.5f;
+			float wy[3];
+			for (int e = 0; e < 3; e++)
+				wy[e] = ex[e] * (py - oy[e]);
+			float zy = z1 + dzdy * (py - y1);
+			float sy = s1 + dsdy * (py - y1);
+
+			CHAR_INFO *pCell = &m_bufScreen[y * m_nScreenWidth + minx];
+			float *pDepth = &m_bufDepth[y * m_nScreenWidth + minx];
+			for (int x = minx; x <= maxx; x++, pCell++, pDepth++)
+			{
+				// Not stepped from the previous cell, so rounding cannot depend on minx
+				float px = (float)x + 0.5f;
+				float w[3];
+				for (int e = 0; e < 3; e++)
+					w[e] = wy[e] - ey[e] * (px - ox[e]);
+				float z = zy + dzdx * (px - x1);
+
+				if (w[0] >= 0.0f && w[1] >= 0.0f && w[2] >= 0.0f && z < *pDepth)
+				{
+					*pDepth = z;
+					if (w[0] < edgeWidth[0] || w[1] < edgeWidth[1] || w[2] < edgeWidth[2])
+					{
+						pCell->Char.UnicodeChar = PIXEL_SOLID;
+						pCell->Attributes = outlineCol;
+					}
+					else
+						*pCell = cell(x, y, sy + dsdx * (px - x1));
+				}
+			}
+		}
+	}
+
 	void DrawCircle(int xc, int yc, int r, short c = 0x2588, short col = 0x000F)
 	{
 		int x = 0;
@@ -703,8 +2092,7 @@ public:
 
 		auto drawline = [&](int sx, int ex, int ny)
 		{
-			for (int i = sx; i <= ex; i++)
-				Draw(i, ny, c, col);
+			DrawSpan(sx, ex + 1, ny, c, col);
 		};
 
 		while (y >= x)
@@ -724,258 +2112,1101 @@ public:
 		if (sprite == nullptr)
 			return;
 
-		for (int i = 0; i < sprite->nWidth; i++)
+		sRect screen = ScreenRect();
+		for (int j = 0; j < sprite->nHeight; j++)
+			DrawSpan(x, y + j, sprite->GlyphRow(j), sprite->ColourRow(j), sprite->nWidth, screen);
+	}
+
+	void DrawPartialSprite(int x, int y, olcSprite *sprite, int ox, int oy, int w, int h)
+	{
+		if (sprite == nullptr)
+			return;
+
+		// Parts of the source rectangle outside the sprite are blank, trim them off
+		if (ox < 0) { x -= ox; w += ox; ox = 0; }
+		if (oy < 0) { y -= oy; h += oy; oy = 0; }
+		w = (std::min)(w, sprite->nWidth - ox);
+		h = (std::min)(h, sprite->nHeight - oy);
+
+		sRect screen = ScreenRect();
+		for (int j = 0; j < h; j++)
+			DrawSpan(x, y + j, sprite->GlyphRow(oy + j) + ox, sprite->ColourRow(oy + j) + ox, w, screen);
+	}
+
+	void DrawWireFrameModel(const std::vector<std::pair<float, float>> &vecModelCoordinates, float x, float y, float r = 0.0f, float s = 1.0f, short col = FG_WHITE, short c = PIXEL_SOLID)
+	{
+		// pair.first = x coordinate
+		// pair.second = y coordinate
+
+		// Create translated model vector of coordinate pairs
+		std::vector<std::pair<float, float>> vecTransformedCoordinates;
+		int verts = vecModelCoordinates.size();
+		vecTransformedCoordinates.resize(verts);
+
+		// Rotate
+		for (int i = 0; i < verts; i++)
+		{
+			vecTransformedCoordinates[i].first = vecModelCoordinates[i].first * cosf(r) - vecModelCoordinates[i].second * sinf(r);
+			vecTransformedCoordinates[i].second = vecModelCoordinates[i].first * sinf(r) + vecModelCoordinates[i].second * cosf(r);
+		}
+
+		// Scale
+		for (int i = 0; i < verts; i++)
+		{
+			vecTransformedCoordinates[i].first = vecTransformedCoordinates[i].first * s;
+			vecTransformedCoordinates[i].second = vecTransformedCoordinates[i].second * s;
+		}
+
+		// Translate
+		for (int i = 0; i < verts; i++)
+		{
+			vecTransformedCoordinates[i].first = vecTransformedCoordinates[i].first + x;
+			vecTransformedCoordinates[i].second = vecTransformedCoordinates[i].second + y;
+		}
+
+		// Draw Closed Polygon
+		for (int i = 0; i < verts + 1; i++)
+		{
+			int j = (i + 1);
+			DrawLine((int)vecTransformedCoordinates[i % verts].first, (int)vecTransformedCoordinates[i % verts].second,
+				(int)vecTransformedCoordinates[j % verts].first, (int)vecTransformedCoordinates[j % verts].second, c, col);
+		}
+	}
+
+	~olcConsoleGameEngine()
+	{
+#ifdef _WIN32
+		if (!m_bHeadless)
+			SetConsoleActiveScreenBuffer(m_hOriginalConsole);
+#endif
+		StopInput();
+		StopPresenting();
+		for (int i = 1; i < nScreenBuffers; i++)
+			delete[] m_bufScreens[i];
+		if (m_bufScreens[0] != nullptr)
+			m_bufScreen = m_bufScreens[0];
+		delete[] m_bufScreen;
+		delete[] m_bufPresented;
+		delete[] m_bufDepth;
+	}
+
+public:
+	void Start()
+	{	
+		// Start the thread
+		m_bAtomActive = true;
+		std::thread t = std::thread(&olcConsoleGameEngine::GameThread, this);
+
+		// Wait for thread to be exited
+		t.join();
+	}
+
+	int ScreenWidth()
+	{
+		return m_nScreenWidth;
+	}
+
+	int ScreenHeight() 
+	{
+		return m_nScreenHeight;
+	}
+
+	// Caps the frame rate at fFramesPerSecond, or runs as fast as possible
+	// with 0, the default. Between frames the game thread sleeps until just
+	// before the next one is due and spins for the rest, so frames start on
+	// time without keeping a core busy. Headless runs are never capped.
+	void SetTargetFrameRate(float fFramesPerSecond)
+	{
+		m_fTargetFrameTime = fFramesPerSecond > 0.0f ? 1.0f / fFramesPerSecond : 0.0f;
+	}
+
+	// Calls OnUserFixedUpdate() once for every fTimeStep seconds that pass,
+	// before each OnUserUpdate(), or never with 0, the default. Simulation
+	// then steps the same way whatever the frame rate, and OnUserUpdate()
+	// can draw the state FixedUpdateAlpha() of the way from the last fixed
+	// update towards the next.
+	void SetFixedTimeStep(float fTimeStep)
+	{
+		m_fFixedTimeStep = (std::max)(0.0f, fTimeStep);
+		m_fFixedAccumulator = 0.0;
+		m_fFixedAlpha = 0.0f;
+	}
+
+	float FixedUpdateAlpha() { return m_fFixedAlpha; }
+
+	// Time between frames over the last nPacingFrames: the mean, its standard
+	// deviation and the longest, in milliseconds
+	struct sFramePacing
+	{
+		float fMeanMs;
+		float fJitterMs;
+		float fWorstMs;
+	};
+
+	sFramePacing FramePacing()
+	{
+		sFramePacing pacing = { 0.0f, 0.0f, 0.0f };
+		int n = (int)(std::min)(m_nPacingCount, (uint64_t)nPacingFrames);
+		if (n == 0)
+			return pacing;
+
+		double fSum = 0.0, fSumSq = 0.0;
+		for (int i = 0; i < n; i++)
+		{
+			fSum += m_fFrameIntervals[i];
+			fSumSq += (double)m_fFrameIntervals[i] * m_fFrameIntervals[i];
+			pacing.fWorstMs = (std::max)(pacing.fWorstMs, m_fFrameIntervals[i] * 1000.0f);
+		}
+		double fMean = fSum / n;
+		pacing.fMeanMs = (float)(fMean * 1000.0);
+		pacing.fJitterMs = (float)(sqrt((std::max)(0.0, fSumSq / n - fMean * fMean)) * 1000.0);
+		return pacing;
+	}
+
+private:
+	// Sleeps wake up late, by as much as a scheduler tick, so sleep until a
+	// little before t and spin the rest of the way
+	static void WaitUntil(std::chrono::steady_clock::time_point t)
+	{
+		const auto tSpin = std::chrono::microseconds(2000);
+		auto tNow = std::chrono::steady_clock::now();
+		if (t - tNow > tSpin)
+			std::this_thread::sleep_for(t - tNow - tSpin);
+		while (std::chrono::steady_clock::now() < t)
+			std::this_thread::yield();
+	}
+
+	// Brings m_keys, m_mouse and the mouse position up to date for this frame,
+	// from whatever the input thread has queued since the last one
+	void UpdateInput()
+	{
+		// Pressed and released only last for the frame they happen in
+		for (int i = 0; i < m_nKeysChanged; i++)
+		{
+			m_keys[m_nKeyChanged[i]].bPressed = false;
+			m_keys[m_nKeyChanged[i]].bReleased = false;
+		}
+		m_nKeysChanged = 0;
+		for (int m = 0; m < 5; m++)
+		{
+			m_mouse[m].bPressed = false;
+			m_mouse[m].bReleased = false;
+		}
+
+		// A press and a release can land in the same frame, so even the
+		// quickest tap is seen. Held keys repeating change nothing.
+		auto apply = [](sKeyState &key, bool bDown)
+		{
+			if (bDown)
+			{
+				key.bPressed = key.bPressed || !key.bHeld;
+				key.bHeld = true;
+			}
+			else if (key.bHeld)
+			{
+				key.bReleased = true;
+				key.bHeld = false;
+			}
+		};
+
+		m_nFrameInputTime = 0;
+		olcInputEvent e;
+		while (m_input.Pop(e))
+		{
+			// The oldest input this frame responds to, see InputToPhotonMs()
+			if (m_nFrameInputTime == 0)
+				m_nFrameInputTime = e.nTime;
+
+			switch (e.nType)
+			{
+			case olcInputEvent::KEY:
+			{
+				sKeyState &key = m_keys[e.nCode & 0xFF];
+				bool bMarked = key.bPressed || key.bReleased;
+				apply(key, e.bDown);
+				if (!bMarked && (key.bPressed || key.bReleased))
+					m_nKeyChanged[m_nKeysChanged++] = (uint8_t)e.nCode;
+			}
+			break;
+
+			case olcInputEvent::MOUSE_BUTTON:
+				if (e.nCode < 5)
+					apply(m_mouse[e.nCode], e.bDown);
+				break;
+
+			case olcInputEvent::MOUSE_MOVE:
+				m_mousePosX = e.x;
+				m_mousePosY = e.y;
+				break;
+
+			case olcInputEvent::FOCUS:
+				m_bConsoleInFocus = e.bDown;
+				break;
+
+			default:
+				break;
+			}
+		}
+	}
+
+	void GameThread()
+	{
+		OLC_TRACE_THREAD("Game");
+
+		// Create user resources as part of this thread
+		if (!OnUserCreate()) 
+			m_bAtomActive = false;
+
+		// Check if sound system should be enabled. There is no audio device
+		// when headless.
+		if (m_bHeadless)
+			m_bEnableSound = false;
+
+		if (m_bEnableSound)
+		{
+			if (!CreateAudio())
+			{
+				m_bAtomActive = false; // Failed to create audio system			
+				m_bEnableSound = false;
+			}
+		}
+
+		// Nothing to run, but the console or terminal still has to be put back
+		if (!m_bAtomActive)
+		{
+			EndGameThread();
+			return;
+		}
+
+		if (!m_bHeadless)
+		{
+#ifdef _WIN32
+			// Sleeps to the nearest millisecond rather than the default 15.6,
+			// for the frame rate cap
+			timeBeginPeriod(1);
+			m_bTimerPeriod = true;
+#endif
+			StartPresenting();
+			StartInput();
+		}
+
+		auto tp1 = std::chrono::steady_clock::now();
+		auto tp2 = tp1;
+		auto tNextFrame = tp1;
+		int nFrame = 0;
+		double fTime = 0.0;
+
+		while (m_bAtomActive)
+		{
+			// Run as fast as possible
+			while (m_bAtomActive)
+			{
+				// Handle Timing. Headless runs use a synthetic clock, so every
+				// run of the same frame count sees the same elapsed times.
+				float fElapsedTime = m_fHeadlessTimeStep;
+				if (!m_bHeadless)
+				{
+					if (m_fTargetFrameTime > 0.0f)
+					{
+						OLC_TRACE_ZONE("wait");
+						auto tFrame = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(m_fTargetFrameTime));
+						tNextFrame += tFrame;
+
+						// More than a frame behind, or the cap was only just
+						// turned on. Start again from now rather than rush to
+						// catch up.
+						auto tNow = std::chrono::steady_clock::now();
+						if (tNextFrame + tFrame < tNow)
+							tNextFrame = tNow;
+						WaitUntil(tNextFrame);
+					}
+
+					tp2 = std::chrono::steady_clock::now();
+					std::chrono::duration<float> elapsedTime = tp2 - tp1;
+					tp1 = tp2;
+					fElapsedTime = elapsedTime.count();
+
+					OLC_TRACE_ZONE("input poll");
+					UpdateInput();
+				}
+
+				m_fFrameIntervals[m_nPacingCount++ % nPacingFrames] = fElapsedTime;
+
+				// Fixed updates due by now. If they fall so far behind that
+				// nMaxFixedSteps cannot catch up, e.g. after a breakpoint, the
+				// rest are dropped rather than run all at once.
+				if (m_fFixedTimeStep > 0.0f)
+				{
+					OLC_TRACE_ZONE("fixed update");
+					m_fFixedAccumulator += fElapsedTime;
+					for (int nStep = 0; nStep < nMaxFixedSteps && m_fFixedAccumulator >= m_fFixedTimeStep && m_bAtomActive; nStep++)
+					{
+						if (!OnUserFixedUpdate(m_fFixedTimeStep))
+							m_bAtomActive = false;
+						m_fFixedAccumulator -= m_fFixedTimeStep;
+					}
+					if (m_fFixedAccumulator >= m_fFixedTimeStep)
+						m_fFixedAccumulator = fmod(m_fFixedAccumulator, (double)m_fFixedTimeStep);
+					m_fFixedAlpha = (float)(m_fFixedAccumulator / m_fFixedTimeStep);
+				}
+
+				// Handle Frame Update
+				{
+					OLC_TRACE_ZONE("update");
+					if (!OnUserUpdate(fElapsedTime))
+						m_bAtomActive = false;
+				}
+
+				fTime += fElapsedTime;
+				if (m_recorder.IsOpen())
+				{
+					OLC_TRACE_ZONE("record");
+					m_recorder.Write(m_bufScreen, fTime);
+				}
+
+				if (m_bHeadless)
+				{
+					// Nothing to present to, the frame stays in m_bufScreen
+					if (++nFrame >= m_nHeadlessFrames)
+						m_bAtomActive = false;
+					continue;
+				}
+
+				// Hand the frame to the present thread and carry on with the next
+				OLC_TRACE_ZONE("submit");
+				SubmitFrame(fElapsedTime);
+			}
+
+			if (m_bEnableSound)
+			{
+				// Close and Clean up audio system
+			}
+
+			// Allow the user to free resources if they have overrided the destroy function
+			if (OnUserDestroy())
+			{
+				// User has permitted destroy, so exit and clean up
+				EndGameThread();
+			}
+			else
+			{
+				// User denied destroy for some reason, so continue running
+				m_bAtomActive = true;
+			}
+		}
+	}
+
+	// Every way out of GameThread() comes through here. Stops the input and
+	// present threads and hands the console or terminal back as it was. The
+	// screen buffer is kept until the engine goes, so a headless run can still
+	// save it after Start() returns.
+	void EndGameThread()
+	{
+		StopInput();
+		StopPresenting();
+		m_recorder.Close();
+#ifdef _WIN32
+		if (m_bTimerPeriod)
+		{
+			timeEndPeriod(1);
+			m_bTimerPeriod = false;
+		}
+#endif
+		if (m_bTerminal)
+		{
+			const char *sLeave = "\x1b[0m\x1b[?25h\x1b[?1049l";
+			WriteTerminal(sLeave, strlen(sLeave));
+#ifndef _WIN32
+			if (m_bTerminalInput)
+			{
+				const char *sInputOff = "\x1b[<u\x1b[?1004l\x1b[?1006l\x1b[?1003l";
+				WriteTerminal(sInputOff, strlen(sInputOff));
+				tcsetattr(STDIN_FILENO, TCSAFLUSH, &m_termiosOriginal);
+			}
+#endif
+		}
+#ifdef _WIN32
+		else if (!m_bHeadless)
+			SetConsoleActiveScreenBuffer(m_hOriginalConsole);
+#endif
+		m_cvGameFinished.notify_one();
+	}
+
+private: // Present thread =======================================================================
+
+	// Frames are presented on their own thread, so writing one out to the
+	// console or terminal overlaps with drawing the next. OnUserUpdate() draws
+	// into m_bufScreen, one of nScreenBuffers; SubmitFrame() queues it and
+	// moves m_bufScreen on to a free buffer. When the presenter falls behind
+	// and no buffer is free, the oldest frame still queued is dropped rather
+	// than making the game wait.
+	void StartPresenting()
+	{
+		if (m_bPresenting)
+			return;
+
+		int nCells = m_nScreenWidth * m_nScreenHeight;
+		for (int i = 0; i < nScreenBuffers; i++)
+		{
+			if (i == 0)
+				m_bufScreens[i] = m_bufScreen;
+			else if (m_bufScreens[i] == nullptr)
+				m_bufScreens[i] = new CHAR_INFO[nCells];
+			m_nBufferState[i] = BUFFER_FREE;
+		}
+		m_nBufferState[0] = BUFFER_DRAWING;
+		m_nDrawing = 0;
+		m_nQueued = 0;
+		m_bPresentStop = false;
+		m_bPresenting = true;
+		m_threadPresent = std::thread(&olcConsoleGameEngine::PresentThread, this);
+	}
+
+	// Presents whatever is still queued, then ends the present thread
+	void StopPresenting()
+	{
+		if (!m_bPresenting)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(m_muxPresent);
+			m_bPresentStop = true;
+		}
+		m_cvPresent.notify_all();
+		m_threadPresent.join();
+		m_bPresenting = false;
+	}
+
+	void SubmitFrame(float fElapsedTime)
+	{
+		int nSubmitted = m_nDrawing;
+		{
+			std::unique_lock<std::mutex> lock(m_muxPresent);
+			m_nBufferState[nSubmitted] = BUFFER_QUEUED;
+			m_queue[m_nQueued++] = { nSubmitted, fElapsedTime, m_nFrameInputTime };
+			m_cvPresent.notify_all();
+
+			// A free buffer to draw the next frame in. Failing that, the oldest
+			// queued frame is dropped and its buffer reused. Only with two
+			// buffers can there be neither, until the presenter finishes.
+			int nNext = -1;
+			while (nNext < 0)
+			{
+				for (int i = 0; i < nScreenBuffers && nNext < 0; i++)
+					if (m_nBufferState[i] == BUFFER_FREE)
+						nNext = i;
+
+				if (nNext < 0 && m_nQueued > 1)
+				{
+					nNext = m_queue[0].nBuffer;
+					m_nQueued--;
+					memmove(m_queue, m_queue + 1, sizeof(sQueuedFrame) * m_nQueued);
+					m_nFramesDropped++;
+				}
+
+				if (nNext < 0)
+					m_cvPresent.wait(lock);
+			}
+			m_nBufferState[nNext] = BUFFER_DRAWING;
+			m_nDrawing = nNext;
+		}
+
+		// Applications may only draw what changed, so the next frame starts
+		// out as a copy of this one. Only this thread ever writes to a queued
+		// buffer, so it can be read without the lock.
+		m_bufScreen = m_bufScreens[m_nDrawing];
+		memcpy(m_bufScreen, m_bufScreens[nSubmitted], sizeof(CHAR_INFO) * m_nScreenWidth * m_nScreenHeight);
+	}
+
+	void PresentThread()
+	{
+		OLC_TRACE_THREAD("Present");
+
+		while (true)
+		{
+			sQueuedFrame frame;
+			{
+				std::unique_lock<std::mutex> lock(m_muxPresent);
+				m_cvPresent.wait(lock, [&] { return m_nQueued > 0 || m_bPresentStop; });
+				if (m_nQueued == 0)
+					break;
+
+				frame = m_queue[0];
+				m_nQueued--;
+				memmove(m_queue, m_queue + 1, sizeof(sQueuedFrame) * m_nQueued);
+				m_nBufferState[frame.nBuffer] = BUFFER_PRESENTING;
+			}
+
+			{
+				OLC_TRACE_ZONE("present");
+				const CHAR_INFO *pFrame = m_bufScreens[frame.nBuffer];
+				if (m_bTerminal)
+				{
+					if (!PresentTerminal(pFrame))
+						m_bAtomActive = false;
+				}
+#ifdef _WIN32
+				else
+				{
+					// Update Title & Present Screen Buffer
+					wchar_t s[256];
+					swprintf_s(s, 256, L"OneLoneCoder.com - Console Game Engine - %s - FPS: %3.2f", m_sAppName.c_str(), 1.0f / frame.fElapsedTime);
+					SetConsoleTitle(s);
+					WriteConsoleOutput(m_hConsole, pFrame, { (short)m_nScreenWidth, (short)m_nScreenHeight }, { 0,0 }, &m_rectWindow);
+				}
+#endif
+			}
+
+			if (frame.nInputTime != 0)
+				m_fInputToPhotonMs = (float)((olcInputQueue::Now() - frame.nInputTime) / 1e6);
+
+			{
+				std::lock_guard<std::mutex> lock(m_muxPresent);
+				m_nBufferState[frame.nBuffer] = BUFFER_FREE;
+			}
+			m_cvPresent.notify_all();
+		}
+	}
+
+public:
+	// Frames the present thread skipped because newer ones were ready first
+	uint64_t FramesDropped() { return m_nFramesDropped; }
+
+	// From when the oldest input a frame responded to was read, to that frame
+	// having been written out, for the last frame that had any input
+	float InputToPhotonMs() { return m_fInputToPhotonMs; }
+
+private: // Input thread =========================================================================
+
+	// Key and mouse events are read as they arrive, on a thread of their own,
+	// and queued for UpdateInput() along with when they were read. Nothing is
+	// polled once a frame, and nothing is lost when many arrive at once.
+	void StartInput()
+	{
+#ifndef _WIN32
+		if (!m_bTerminalInput)
+			return;
+#endif
+		m_bInputStop = false;
+		m_threadInput = std::thread(&olcConsoleGameEngine::InputThread, this);
+	}
+
+	void StopInput()
+	{
+		if (!m_threadInput.joinable())
+			return;
+		m_bInputStop = true;
+		m_threadInput.join();
+	}
+
+	void PushInput(uint8_t nType, bool bDown, uint16_t nCode = 0, int x = 0, int y = 0)
+	{
+		olcInputEvent e = { nType, bDown, nCode, (int16_t)x, (int16_t)y, olcInputQueue::Now() };
+
+		// Rather than drop anything, wait for the game thread to catch up
+		while (!m_input.Push(e) && !m_bInputStop)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+#ifdef _WIN32
+	void InputThread()
+	{
+		OLC_TRACE_THREAD("Input");
+
+		INPUT_RECORD inBuf[64];
+		DWORD nButtons = 0;
+		while (!m_bInputStop)
+		{
+			// Wakes up now and then to see whether it is time to stop
+			if (WaitForSingleObject(m_hConsoleIn, 50) != WAIT_OBJECT_0)
+				continue;
+
+			DWORD events = 0;
+			if (!ReadConsoleInput(m_hConsoleIn, inBuf, 64, &events))
+				break;
+
+			for (DWORD i = 0; i < events; i++)
+			{
+				switch (inBuf[i].EventType)
+				{
+				case KEY_EVENT:
+					PushInput(olcInputEvent::KEY, inBuf[i].Event.KeyEvent.bKeyDown != 0, inBuf[i].Event.KeyEvent.wVirtualKeyCode);
+					break;
+
+				case FOCUS_EVENT:
+					PushInput(olcInputEvent::FOCUS, inBuf[i].Event.FocusEvent.bSetFocus != 0);
+					break;
+
+				case MOUSE_EVENT:
+				{
+					const MOUSE_EVENT_RECORD &mouse = inBuf[i].Event.MouseEvent;
+					if (mouse.dwEventFlags & MOUSE_MOVED)
+						PushInput(olcInputEvent::MOUSE_MOVE, false, 0, mouse.dwMousePosition.X, mouse.dwMousePosition.Y);
+
+					// Buttons 0 to 4 are the low bits of the button state
+					DWORD nChanged = (mouse.dwButtonState ^ nButtons) & 0x1F;
+					for (int m = 0; m < 5; m++)
+						if (nChanged & (1 << m))
+							PushInput(olcInputEvent::MOUSE_BUTTON, (mouse.dwButtonState & (1 << m)) != 0, (uint16_t)m);
+					nButtons = mouse.dwButtonState;
+				}
+				break;
+
+				default:
+					break;
+				}
+			}
+		}
+	}
+#else
+	void InputThread()
+	{
+		OLC_TRACE_THREAD("Input");
+
+		std::string sSequence;
+		while (!m_bInputStop)
+		{
+			// Wakes up now and then to see whether it is time to stop, and in
+			// time to release any key that has stopped repeating
+			int nTimeout = 50;
+			uint64_t nNow = olcInputQueue::Now();
+			for (uint64_t nUntil : m_nKeyHeldUntil)
+				if (nUntil != 0)
+					nTimeout = (std::min)(nTimeout, nUntil > nNow ? (int)((nUntil - nNow) / 1000000) + 1 : 0);
+
+			pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+			int nReady = poll(&pfd, 1, nTimeout);
+			if (nReady > 0)
+			{
+				unsigned char buf[256];
+				ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+				if (n < 0 && errno == EINTR)
+					continue;
+				if (n <= 0)
+					break;
+				for (ssize_t i = 0; i < n; i++)
+					ReadTerminalByte(buf[i], sSequence);
+			}
+			else if (sSequence == "\x1b")
+			{
+				// Nothing followed the escape, so it was the Escape key itself
+				sSequence.clear();
+				TerminalKey(VK_ESCAPE, 1, true);
+			}
+
+			nNow = olcInputQueue::Now();
+			for (int k = 0; k < 256; k++)
+			{
+				if (m_nKeyHeldUntil[k] != 0 && m_nKeyHeldUntil[k] <= nNow)
+				{
+					m_nKeyHeldUntil[k] = 0;
+					PushInput(olcInputEvent::KEY, false, (uint16_t)k);
+				}
+			}
+		}
+	}
+
+	void ReadTerminalByte(unsigned char b, std::string &sSequence)
+	{
+		if (sSequence.empty())
+		{
+			if (b == 0x1b)
+				sSequence += (char)b;
+			else
+				TerminalKey(TerminalKeyCode(b), 1, true);
+			return;
+		}
+
+		sSequence += (char)b;
+		if (sSequence.size() == 2)
 		{
-			for (int j = 0; j < sprite->nHeight; j++)
+			// ESC [ starts a control sequence and ESC O a function key.
+			// Anything else is a key typed with Alt held.
+			if (b == '[' || b == 'O')
+				return;
+			sSequence.clear();
+			if (b == 0x1b)
 			{
-				if (sprite->GetGlyph(i, j) != L' ')
-					Draw(x + i, y + j, sprite->GetGlyph(i, j), sprite->GetColour(i, j));
+				TerminalKey(VK_ESCAPE, 1, true);
+				sSequence += (char)b;
 			}
+			else
+				TerminalKey(TerminalKeyCode(b), 1, true);
+			return;
 		}
+
+		bool bFinal = (b >= 0x40 && b <= 0x7E) || sSequence[1] == 'O';
+		if (bFinal)
+			TerminalSequence(sSequence);
+		if (bFinal || sSequence.size() > 32)
+			sSequence.clear();
 	}
 
-	void DrawPartialSprite(int x, int y, olcSprite *sprite, int ox, int oy, int w, int h)
+	void TerminalSequence(const std::string &sSequence)
 	{
-		if (sprite == nullptr)
-			return;
+		char cFinal = sSequence.back();
+		const char *p = sSequence.c_str() + 2;
 
-		for (int i = 0; i < w; i++)
+		// SGR mouse report: ESC [ < button ; x ; y, then M for a press or
+		// movement, m for a release
+		if (*p == '<')
 		{
-			for (int j = 0; j < h; j++)
+			int b = 0, x = 0, y = 0;
+			if (sscanf(p + 1, "%d;%d;%d", &b, &x, &y) != 3)
+				return;
+			if (x - 1 != m_nTerminalMouseX || y - 1 != m_nTerminalMouseY)
 			{
-				if (sprite->GetGlyph(i+ox, j+oy) != L' ')
-					Draw(x + i, y + j, sprite->GetGlyph(i+ox, j+oy), sprite->GetColour(i+ox, j+oy));
+				m_nTerminalMouseX = x - 1;
+				m_nTerminalMouseY = y - 1;
+				PushInput(olcInputEvent::MOUSE_MOVE, false, 0, x - 1, y - 1);
 			}
-		}
-	}
 
-	void DrawWireFrameModel(const std::vector<std::pair<float, float>> &vecModelCoordinates, float x, float y, float r = 0.0f, float s = 1.0f, short col = FG_WHITE, short c = PIXEL_SOLID)
-	{
-		// pair.first = x coordinate
-		// pair.second = y coordinate
+			// Numbered left, right, middle like the Windows console. Wheel
+			// and movement reports have bits 64 and 32 set.
+			static const uint16_t nButton[3] = { 0, 2, 1 };
+			if ((b & (64 | 32)) == 0 && (b & 3) < 3)
+				PushInput(olcInputEvent::MOUSE_BUTTON, cFinal == 'M', nButton[b & 3]);
+			return;
+		}
 
-		// Create translated model vector of coordinate pairs
-		std::vector<std::pair<float, float>> vecTransformedCoordinates;
-		int verts = vecModelCoordinates.size();
-		vecTransformedCoordinates.resize(verts);
+		// Replies to queries, which nothing here asks for
+		if (*p == '?' || *p == '>')
+			return;
 
-		// Rotate
-		for (int i = 0; i < verts; i++)
+		// Key number, with any alternates after colons, then the modifiers
+		// plus one, with the kitty event type after a colon: 1 press, 2
+		// repeat, 3 release
+		char *pEnd;
+		int nKey = (int)strtol(p, &pEnd, 10);
+		while (*pEnd == ':')
+			strtol(pEnd + 1, &pEnd, 10);
+		int nModifiers = 1, nEvent = 1;
+		if (*pEnd == ';')
 		{
-			vecTransformedCoordinates[i].first = vecModelCoordinates[i].first * cosf(r) - vecModelCoordinates[i].second * sinf(r);
-			vecTransformedCoordinates[i].second = vecModelCoordinates[i].first * sinf(r) + vecModelCoordinates[i].second * cosf(r);
+			nModifiers = (int)strtol(pEnd + 1, &pEnd, 10);
+			if (*pEnd == ':')
+				nEvent = (int)strtol(pEnd + 1, &pEnd, 10);
 		}
 
-		// Scale
-		for (int i = 0; i < verts; i++)
+		int nCode = 0;
+		switch (cFinal)
 		{
-			vecTransformedCoordinates[i].first = vecTransformedCoordinates[i].first * s;
-			vecTransformedCoordinates[i].second = vecTransformedCoordinates[i].second * s;
+		case 'u':
+			// With every key reported like this Ctrl+C no longer raises
+			// SIGINT, so do what its handler would
+			if (nKey == 'c' && ((nModifiers - 1) & 4) && nEvent != 3)
+				m_bAtomActive = false;
+			nCode = TerminalKeyCode((uint32_t)nKey);
+			break;
+		case 'A': nCode = VK_UP; break;
+		case 'B': nCode = VK_DOWN; break;
+		case 'C': nCode = VK_RIGHT; break;
+		case 'D': nCode = VK_LEFT; break;
+		case 'H': nCode = VK_HOME; break;
+		case 'F': nCode = VK_END; break;
+		case 'P': nCode = VK_F1; break;
+		case 'Q': nCode = VK_F2; break;
+		case 'R': nCode = VK_F3; break;
+		case 'S': nCode = VK_F4; break;
+		case '~':
+			switch (nKey)
+			{
+			case 2: nCode = VK_INSERT; break;
+			case 3: nCode = VK_DELETE; break;
+			case 5: nCode = VK_PRIOR; break;
+			case 6: nCode = VK_NEXT; break;
+			case 7: nCode = VK_HOME; break;
+			case 8: nCode = VK_END; break;
+			case 11: case 12: case 13: case 14: nCode = VK_F1 + nKey - 11; break;
+			case 15: nCode = VK_F5; break;
+			case 17: case 18: case 19: case 20: case 21: nCode = VK_F6 + nKey - 17; break;
+			case 23: case 24: nCode = VK_F11 + nKey - 23; break;
+			default: break;
+			}
+			break;
+		case 'I':
+			PushInput(olcInputEvent::FOCUS, true);
+			return;
+		case 'O':
+			PushInput(olcInputEvent::FOCUS, false);
+			return;
+		default:
+			break;
 		}
 
-		// Translate
-		for (int i = 0; i < verts; i++)
+		// Only the kitty protocol says what kind of event it was. Without it
+		// there are no releases, just repeats.
+		bool bKitty = cFinal == 'u' || nEvent != 1;
+		TerminalKey(nCode, nEvent, !bKitty);
+	}
+
+	// Terminals that don't report releases only repeat a key while it is
+	// held, so for them bRepeatsOnly counts a key as released once its
+	// repeats stop. That takes a little longer than the usual delay before
+	// the first repeat, so a quick tap is held for about that long.
+	void TerminalKey(int nCode, int nEvent, bool bRepeatsOnly)
+	{
+		if (nCode <= 0 || nCode > 0xFF)
+			return;
+
+		if (nEvent == 3)
 		{
-			vecTransformedCoordinates[i].first = vecTransformedCoordinates[i].first + x;
-			vecTransformedCoordinates[i].second = vecTransformedCoordinates[i].second + y;
+			m_nKeyHeldUntil[nCode] = 0;
+			PushInput(olcInputEvent::KEY, false, (uint16_t)nCode);
+			return;
 		}
 
-		// Draw Closed Polygon
-		for (int i = 0; i < verts + 1; i++)
+		if (bRepeatsOnly)
 		{
-			int j = (i + 1);
-			DrawLine((int)vecTransformedCoordinates[i % verts].first, (int)vecTransformedCoordinates[i % verts].second,
-				(int)vecTransformedCoordinates[j % verts].first, (int)vecTransformedCoordinates[j % verts].second, c, col);
+			bool bHeld = m_nKeyHeldUntil[nCode] != 0;
+			m_nKeyHeldUntil[nCode] = olcInputQueue::Now() + (bHeld ? 100000000ull : 700000000ull);
+			if (bHeld)
+				return;
 		}
+		else
+			m_nKeyHeldUntil[nCode] = 0;	// A release will follow, no need to guess
+		PushInput(olcInputEvent::KEY, true, (uint16_t)nCode);
 	}
 
-	~olcConsoleGameEngine()
+	// Virtual key code for a character typed, or a kitty protocol key number
+	static int TerminalKeyCode(uint32_t c)
 	{
-		SetConsoleActiveScreenBuffer(m_hOriginalConsole);
-		delete[] m_bufScreen;
-	}
-
-public:
-	void Start()
-	{	
-		// Start the thread
-		m_bAtomActive = true;
-		std::thread t = std::thread(&olcConsoleGameEngine::GameThread, this);
+		switch (c)
+		{
+		case ' ': return VK_SPACE;
+		case '\r': case '\n': return VK_RETURN;
+		case '\t': return VK_TAB;
+		case 0x08: case 0x7F: return VK_BACK;
+		case 0x1B: return VK_ESCAPE;
+		case '-': case '_': return VK_OEM_MINUS;
+		case '=': case '+': return VK_OEM_PLUS;
+		case ',': case '<': return VK_OEM_COMMA;
+		case '.': case '>': return VK_OEM_PERIOD;
+		case 57441: case 57447: return VK_SHIFT;
+		case 57442: case 57448: return VK_CONTROL;
+		case 57443: case 57449: return VK_MENU;
+		default: break;
+		}
 
-		// Wait for thread to be exited
-		t.join();
+		if (c >= 'a' && c <= 'z')
+			return (int)(c - 'a' + 'A');
+		if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+			return (int)c;
+		if (c >= 0x01 && c <= 0x1A)
+			return (int)(c - 0x01 + 'A');	// Ctrl with a letter
+		return 0;
 	}
+#endif
 
-	int ScreenWidth()
-	{
-		return m_nScreenWidth;
-	}
+protected: // Terminal presenter ================================================================
 
-	int ScreenHeight() 
+	// Builds the bytes that take the terminal from the last presented frame to
+	// this one. Unchanged cells are skipped over with a cursor move, or just
+	// sent again when that is shorter, and colours are only set when they
+	// change, so a mostly static frame costs very little. Usable without a
+	// terminal too, to measure the cost of presenting.
+	const std::string &EncodeTerminalFrame()
 	{
-		return m_nScreenHeight;
+		return EncodeTerminalFrame(m_bufScreen);
 	}
 
-private:
-	void GameThread()
+	const std::string &EncodeTerminalFrame(const CHAR_INFO *pFrame)
 	{
-		// Create user resources as part of this thread
-		if (!OnUserCreate()) 
-			m_bAtomActive = false;
-
-		// Check if sound system should be enabled
-		if (m_bEnableSound)
-		{
-			if (!CreateAudio())
-			{
-				m_bAtomActive = false; // Failed to create audio system			
-				m_bEnableSound = false;
-			}
-		}
+		if (m_bufPresented == nullptr)
+			m_bufPresented = new CHAR_INFO[m_nScreenWidth*m_nScreenHeight];
 
-		auto tp1 = std::chrono::system_clock::now();
-		auto tp2 = std::chrono::system_clock::now();
+		std::string &out = m_sTerminalFrame;
+		out.clear();
 
-		while (m_bAtomActive)
+		bool bFull = m_nTerminalFrames == 0;
+		for (int y = 0; y < m_nScreenHeight; y++)
 		{
-			// Run as fast as possible
-			while (m_bAtomActive)
+			const CHAR_INFO *pRow = pFrame + y * m_nScreenWidth;
+			const CHAR_INFO *pOld = m_bufPresented + y * m_nScreenWidth;
+			for (int x = 0; x < m_nScreenWidth; x++)
 			{
-				// Handle Timing
-				tp2 = std::chrono::system_clock::now();
-				std::chrono::duration<float> elapsedTime = tp2 - tp1;
-				tp1 = tp2;
-				float fElapsedTime = elapsedTime.count();
-
-				// Handle Keyboard Input
-				for (int i = 0; i < 256; i++)
+				if (!bFull && pRow[x].Char.UnicodeChar == pOld[x].Char.UnicodeChar && pRow[x].Attributes == pOld[x].Attributes)
+					continue;
+
+				// A solid block looks just like a space in the background colour,
+				// which is a third of the size and needs no foreground colour
+				uint32_t c = pRow[x].Char.UnicodeChar;
+				int nAttr = pRow[x].Attributes;
+				if (c == PIXEL_SOLID)
 				{
-					m_keyNewState[i] = GetAsyncKeyState(i);
+					c = L' ';
+					nAttr = (nAttr & 0x0F) << 4;
+				}
 
-					m_keys[i].bPressed = false;
-					m_keys[i].bReleased = false;
+				MoveTerminalCursor(out, x, y, pRow);
+				SetTerminalColour(out, nAttr, c == 0 || c == L' ');
+				AppendUtf8(out, c);
 
-					if (m_keyNewState[i] != m_keyOldState[i])
-					{
-						if (m_keyNewState[i] & 0x8000)
-						{
-							m_keys[i].bPressed = !m_keys[i].bHeld;
-							m_keys[i].bHeld = true;
-						}
-						else
-						{
-							m_keys[i].bReleased = true;
-							m_keys[i].bHeld = false;
-						}
-					}
+				// After the last column the terminal is waiting to wrap, so
+				// the column is as good as unknown
+				m_nTerminalX = x + 1;
+			}
+		}
 
-					m_keyOldState[i] = m_keyNewState[i];
-				}
+		memcpy(m_bufPresented, pFrame, sizeof(CHAR_INFO) * m_nScreenWidth * m_nScreenHeight);
 
-				// Handle Mouse Input - Check for window events
-				INPUT_RECORD inBuf[32];
-				DWORD events = 0;
-				GetNumberOfConsoleInputEvents(m_hConsoleIn, &events);
-				if (events > 0)
-					ReadConsoleInput(m_hConsoleIn, inBuf, events, &events);
+		m_nTerminalBytes = out.size();
+		m_nTerminalBytesTotal += out.size();
+		m_nTerminalFrames++;
+		return out;
+	}
 
-				// Handle events - we only care about mouse clicks and movement
-				// for now
-				for (DWORD i = 0; i < events; i++)
-				{
-					switch (inBuf[i].EventType)
-					{
-					case FOCUS_EVENT:
-					{
-						m_bConsoleInFocus = inBuf[i].Event.FocusEvent.bSetFocus;
-					}
-					break;
+private:
+	bool PresentTerminal(const CHAR_INFO *pFrame)
+	{
+		const std::string &out = EncodeTerminalFrame(pFrame);
+		return out.empty() || WriteTerminal(out.data(), out.size());
+	}
 
-					case MOUSE_EVENT:
-					{
-						switch (inBuf[i].Event.MouseEvent.dwEventFlags)
-						{
-						case MOUSE_MOVED:
-						{
-							m_mousePosX = inBuf[i].Event.MouseEvent.dwMousePosition.X;
-							m_mousePosY = inBuf[i].Event.MouseEvent.dwMousePosition.Y;
-						}
-						break;
+	void MoveTerminalCursor(std::string &out, int x, int y, const CHAR_INFO *pRow)
+	{
+		if (y == m_nTerminalY && x == m_nTerminalX)
+			return;
 
-						case 0:
-						{
-							for (int m = 0; m < 5; m++)
-								m_mouseNewState[m] = (inBuf[i].Event.MouseEvent.dwButtonState & (1 << m)) > 0;
+		if (y == m_nTerminalY && x > m_nTerminalX)
+		{
+			// A short gap of plain characters already in the current colour
+			// is cheaper to send again than to step over
+			int nGap = x - m_nTerminalX;
+			bool bResend = nGap <= 3;
+			for (int i = m_nTerminalX; i < x && bResend; i++)
+				bResend = pRow[i].Attributes == m_nTerminalAttr && pRow[i].Char.UnicodeChar > 0x20 && pRow[i].Char.UnicodeChar < 0x80;
+
+			if (bResend)
+			{
+				for (int i = m_nTerminalX; i < x; i++)
+					out += (char)pRow[i].Char.UnicodeChar;
+			}
+			else
+			{
+				out += "\x1b[";
+				AppendNumber(out, nGap);
+				out += 'C';
+			}
+		}
+		else if (x == 0 && m_nTerminalY >= 0 && y == m_nTerminalY + 1)
+		{
+			out += "\r\n";
+		}
+		else
+		{
+			out += "\x1b[";
+			AppendNumber(out, y + 1);
+			out += ';';
+			AppendNumber(out, x + 1);
+			out += 'H';
+		}
 
-						}
-						break;
+		m_nTerminalX = x;
+		m_nTerminalY = y;
+	}
 
-						default:
-							break;
-						}
-					}
-					break;
+	// Console attributes are IRGB nibbles for foreground and background, the
+	// SGR colours have red and blue the other way round. Blank cells only need
+	// the background right.
+	void SetTerminalColour(std::string &out, int nAttr, bool bBlank)
+	{
+		if (nAttr == m_nTerminalAttr)
+			return;
 
-					default:
-						break;
-						// We don't care just at the moment
-					}
-				}
+		auto sgr = [](int c, int nBase, int nBright)
+		{
+			return ((c & 8) ? nBright : nBase) + (((c & 1) << 2) | (c & 2) | ((c & 4) >> 2));
+		};
 
-				for (int m = 0; m < 5; m++)
-				{
-					m_mouse[m].bPressed = false;
-					m_mouse[m].bReleased = false;
+		int nFg = nAttr & 0x0F, nBg = (nAttr >> 4) & 0x0F;
+		bool bFg = m_nTerminalAttr < 0 || nFg != (m_nTerminalAttr & 0x0F);
+		bool bBg = m_nTerminalAttr < 0 || nBg != ((m_nTerminalAttr >> 4) & 0x0F);
+		if (bBlank && m_nTerminalAttr >= 0)
+		{
+			if (!bBg)
+				return;
+			bFg = false;
+			nFg = m_nTerminalAttr & 0x0F;
+		}
 
-					if (m_mouseNewState[m] != m_mouseOldState[m])
-					{
-						if (m_mouseNewState[m])
-						{
-							m_mouse[m].bPressed = true;
-							m_mouse[m].bHeld = true;
-						}
-						else
-						{
-							m_mouse[m].bReleased = true;
-							m_mouse[m].bHeld = false;
-						}
-					}
+		out += "\x1b[";
+		if (bFg)
+			AppendNumber(out, sgr(nFg, 30, 90));
+		if (bFg && bBg)
+			out += ';';
+		if (bBg)
+			AppendNumber(out, sgr(nBg, 40, 100));
+		out += 'm';
 
-					m_mouseOldState[m] = m_mouseNewState[m];
-				}
+		m_nTerminalAttr = (nBg << 4) | nFg;
+	}
 
+	static void AppendNumber(std::string &out, int n)
+	{
+		char buf[12];
+		int i = 0;
+		do { buf[i++] = (char)('0' + n % 10); n /= 10; } while (n > 0);
+		while (i > 0)
+			out += buf[--i];
+	}
 
-				// Handle Frame Update
-				if (!OnUserUpdate(fElapsedTime))
-					m_bAtomActive = false;
-
-				// Update Title & Present Screen Buffer
-				wchar_t s[256];
-				swprintf_s(s, 256, L"OneLoneCoder.com - Console Game Engine - %s - FPS: %3.2f", m_sAppName.c_str(), 1.0f / fElapsedTime);
-				SetConsoleTitle(s);
-				WriteConsoleOutput(m_hConsole, m_bufScreen, { (short)m_nScreenWidth, (short)m_nScreenHeight }, { 0,0 }, &m_rectWindow);
-			}
+	// Empty cells are sent as spaces
+	static void AppendUtf8(std::string &out, uint32_t c)
+	{
+		if (c == 0)
+			c = L' ';
 
-			if (m_bEnableSound)
-			{
-				// Close and Clean up audio system
-			}
+		if (c < 0x80)
+			out += (char)c;
+		else if (c < 0x800)
+		{
+			out += (char)(0xC0 | (c >> 6));
+			out += (char)(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000)
+		{
+			out += (char)(0xE0 | (c >> 12));
+			out += (char)(0x80 | ((c >> 6) & 0x3F));
+			out += (char)(0x80 | (c & 0x3F));
+		}
+		else
+		{
+			out += (char)(0xF0 | (c >> 18));
+			out += (char)(0x80 | ((c >> 12) & 0x3F));
+			out += (char)(0x80 | ((c >> 6) & 0x3F));
+			out += (char)(0x80 | (c & 0x3F));
+		}
+	}
 
-			// Allow the user to free resources if they have overrided the destroy function
-			if (OnUserDestroy())
-			{
-				// User has permitted destroy, so exit and clean up
-				delete[] m_bufScreen;
-				SetConsoleActiveScreenBuffer(m_hOriginalConsole);
-				m_cvGameFinished.notify_one();
-			}
-			else
+	bool WriteTerminal(const char *pData, size_t nBytes)
+	{
+#ifdef _WIN32
+		return false;
+#else
+		// One write for the whole frame, unless the terminal takes it in parts
+		while (nBytes > 0)
+		{
+			ssize_t n = write(STDOUT_FILENO, pData, nBytes);
+			if (n < 0)
 			{
-				// User denied destroy for some reason, so continue running
-				m_bAtomActive = true;
+				if (errno == EINTR)
+					continue;
+				return false;
 			}
+			pData += n;
+			nBytes -= (size_t)n;
 		}
+		return true;
+#endif
+	}
+
+#ifndef _WIN32
+	static void TerminalSignalHandler(int)
+	{
+		m_bAtomActive = false;
 	}
+#endif
 
 public:
 	// User MUST OVERRIDE THESE!!
@@ -985,6 +3216,9 @@ public:
 	// Optional for clean up 
 	virtual bool OnUserDestroy()						{ return true; }
 
+	// Optional, see SetFixedTimeStep()
+	virtual bool OnUserFixedUpdate(float fTimeStep)		{ (void)fTimeStep; return true; }
+
 
 
 protected: // Audio Engine =====================================================================
@@ -1027,15 +3261,15 @@ protected: // Audio Engine =====================================================
 			}
 
 			// Search for audio data chunk
-			long nChunksize = 0;
+			int32_t nChunksize = 0;
 			std::fread(&dump, sizeof(char), 4, f); // Read chunk header
-			std::fread(&nChunksize, sizeof(long), 1, f); // Read chunk size
+			std::fread(&nChunksize, sizeof(int32_t), 1, f); // Read chunk size
 			while (strncmp(dump, "data", 4) != 0)
 			{
 				// Not audio data, so just skip it
 				std::fseek(f, nChunksize, SEEK_CUR);
 				std::fread(&dump, sizeof(char), 4, f);
-				std::fread(&nChunksize, sizeof(long), 1, f);
+				std::fread(&nChunksize, sizeof(int32_t), 1, f);
 			}
 
 			// Finally got to data, so read it all in and convert to float samples
@@ -1074,16 +3308,32 @@ protected: // Audio Engine =====================================================
 	std::vector<olcAudioSample> vecAudioSamples;
 
 	// This structure represents a sound that is currently playing. It only
-	// holds the sound ID and where this instance of it is up to for its
-	// current playback
-	struct sCurrentlyPlayingSample
+	// holds the sound ID, the sample data, which never moves once loaded, and
+	// where this instance of it is up to for its current playback. The voices
+	// playing are the first m_nActiveVoices of a fixed pool, so starting and
+	// finishing sounds never allocates. Only the audio thread touches them.
+	struct sVoice
 	{
 		int nAudioSampleID = 0;
+		const float *fSample = nullptr;
+		long nSamples = 0;
+		int nChannels = 1;
 		long nSamplePosition = 0;
-		bool bFinished = false;
+		float fVolume = 1.0f;
 		bool bLoop = false;
 	};
-	std::list<sCurrentlyPlayingSample> listActiveSamples;
+	static const int nMaxVoices = 64;
+	sVoice m_voices[nMaxVoices];
+	int m_nActiveVoices = 0;
+
+	// Requests from the game thread to the audio thread, which acts on them
+	// between blocks
+	struct sAudioCommand
+	{
+		enum { PLAY, STOP, SET_VOLUME, SET_LOOP } nType;
+		sVoice voice;	// The voice to start, or just the ID and setting to change
+	};
+	olcSpscQueue<sAudioCommand, 256> m_audioCommands;
 
 	// Load a 16-bit WAVE file @ 44100Hz ONLY into memory. A sample ID
 	// number is returned if successful, otherwise -1
@@ -1102,22 +3352,98 @@ protected: // Audio Engine =====================================================
 			return -1;
 	}
 
-	// Add sample 'id' to the mixers sounds to play list
-	void PlaySample(int id, bool bLoop = false)
+	// Add sample 'id' to the mixers sounds to play list. When all nMaxVoices
+	// are already playing, the sound is not played. This and the functions
+	// below only queue a request for the audio thread, so must all be called
+	// from the same thread, usually the game thread. They return false when
+	// the request was not queued: sound is off, 'id' is not a sample, or the
+	// audio thread has fallen so far behind that its queue is full.
+	bool PlaySample(int id, bool bLoop = false, float fVolume = 1.0f)
+	{
+		if (!m_bEnableSound || id < 1 || id > (int)vecAudioSamples.size())
+			return false;
+
+		const olcAudioSample &sample = vecAudioSamples[id - 1];
+		sAudioCommand cmd;
+		cmd.nType = sAudioCommand::PLAY;
+		cmd.voice.nAudioSampleID = id;
+		cmd.voice.fSample = sample.fSample;
+		cmd.voice.nSamples = sample.nSamples;
+		cmd.voice.nChannels = sample.nChannels;
+		cmd.voice.fVolume = fVolume;
+		cmd.voice.bLoop = bLoop;
+		return m_audioCommands.Push(cmd);
+	}
+
+	// Stops every playing instance of sample 'id'
+	bool StopSample(int id)
+	{
+		return SendAudioCommand(sAudioCommand::STOP, id);
+	}
+
+	// Changes the volume of every playing instance of sample 'id'
+	bool SetSampleVolume(int id, float fVolume)
+	{
+		return SendAudioCommand(sAudioCommand::SET_VOLUME, id, fVolume);
+	}
+
+	// Starts or stops every playing instance of sample 'id' looping. One that
+	// stops looping plays to the end of the sample first.
+	bool SetSampleLoop(int id, bool bLoop)
+	{
+		return SendAudioCommand(sAudioCommand::SET_LOOP, id, 1.0f, bLoop);
+	}
+
+	bool SendAudioCommand(int nType, int id, float fVolume = 1.0f, bool bLoop = false)
 	{
-		sCurrentlyPlayingSample a;
-		a.nAudioSampleID = id;
-		a.nSamplePosition = 0;
-		a.bFinished = false;
-		a.bLoop = bLoop;
-		listActiveSamples.push_back(a);
+		if (!m_bEnableSound || id < 1 || id > (int)vecAudioSamples.size())
+			return false;
+
+		sAudioCommand cmd;
+		cmd.nType = (decltype(cmd.nType))nType;
+		cmd.voice.nAudioSampleID = id;
+		cmd.voice.fVolume = fVolume;
+		cmd.voice.bLoop = bLoop;
+		return m_audioCommands.Push(cmd);
 	}
 
-	void StopSample(int id)
+	// Acts on everything the game thread has asked for since the last block
+	void ApplyAudioCommands()
 	{
+		sAudioCommand cmd;
+		while (m_audioCommands.Pop(cmd))
+		{
+			if (cmd.nType == sAudioCommand::PLAY)
+			{
+				if (m_nActiveVoices < nMaxVoices)
+					m_voices[m_nActiveVoices++] = cmd.voice;
+				continue;
+			}
+
+			for (int v = 0; v < m_nActiveVoices;)
+			{
+				sVoice &voice = m_voices[v];
+				if (voice.nAudioSampleID != cmd.voice.nAudioSampleID)
+				{
+					v++;
+					continue;
+				}
 
+				if (cmd.nType == sAudioCommand::STOP)
+				{
+					voice = m_voices[--m_nActiveVoices];
+					continue;
+				}
+				if (cmd.nType == sAudioCommand::SET_VOLUME)
+					voice.fVolume = cmd.voice.fVolume;
+				else
+					voice.bLoop = cmd.voice.bLoop;
+				v++;
+			}
+		}
 	}
 
+#ifdef _WIN32
 	// The audio system uses by default a specific wave format
 	bool CreateAudio(unsigned int nSampleRate = 44100, unsigned int nChannels = 1,
 		unsigned int nBlocks = 8, unsigned int nBlockSamples = 512)
@@ -1132,6 +3458,8 @@ protected: // Audio Engine =====================================================
 		m_nBlockCurrent = 0;
 		m_pBlockMemory = nullptr;
 		m_pWaveHeaders = nullptr;
+		m_vecMixBlock.assign(m_nBlockSamples, 0.0f);
+		m_vecUserBlock.assign(m_nBlockSamples, 0.0f);
 
 		// Device is available
 		WAVEFORMATEX waveFormat;
@@ -1202,6 +3530,7 @@ protected: // Audio Engine =====================================================
 	// and then issued to the soundcard.
 	void AudioThread()
 	{
+		OLC_TRACE_THREAD("Audio");
 		m_fGlobalTime = 0.0f;
 		float fTimeStep = 1.0f / (float)m_nSampleRate;
 
@@ -1221,6 +3550,7 @@ protected: // Audio Engine =====================================================
 			}
 
 			// Block is here, so use it
+			OLC_TRACE_ZONE("audio block");
 			m_nBlockFree--;
 
 			// Prepare block for processing
@@ -1238,17 +3568,19 @@ protected: // Audio Engine =====================================================
 					return fmax(fSample, -fMax);
 			};
 
-			for (unsigned int n = 0; n < m_nBlockSamples; n += m_nChannels)
+			// User Process
+			unsigned int nFrames = m_nBlockSamples / m_nChannels;
+			MixBlock(m_vecMixBlock.data(), nFrames, m_fGlobalTime, fTimeStep);
+			m_fGlobalTime = m_fGlobalTime + fTimeStep * nFrames;
+
+			for (unsigned int n = 0; n < nFrames; n++)
 			{
-				// User Process
 				for (unsigned int c = 0; c < m_nChannels; c++)
 				{
-					nNewSample = (short)(clip(GetMixerOutput(c, m_fGlobalTime, fTimeStep), 1.0) * fMaxSample);
-					m_pBlockMemory[nCurrentBlock + n + c] = nNewSample;
+					nNewSample = (short)(clip(m_vecMixBlock[c * nFrames + n], 1.0) * fMaxSample);
+					m_pBlockMemory[nCurrentBlock + n * m_nChannels + c] = nNewSample;
 					nPreviousSample = nNewSample;
 				}
-
-				m_fGlobalTime = m_fGlobalTime + fTimeStep;
 			}
 
 			// Send block to sound device
@@ -1259,26 +3591,67 @@ protected: // Audio Engine =====================================================
 		}
 	}
 
-	// Overridden by user if they want to generate sound in real-time
+#else
+	// Only the Windows wave device is supported
+	bool CreateAudio(unsigned int nSampleRate = 44100, unsigned int nChannels = 1,
+		unsigned int nBlocks = 8, unsigned int nBlockSamples = 512)
+	{
+		(void)nSampleRate; (void)nChannels; (void)nBlocks; (void)nBlockSamples;
+		return false;
+	}
+#endif
+
+	// Overridden by user if they want to generate sound in real-time, a
+	// block at a time: fill pOut with nFrames samples for nChannel, the first
+	// at fGlobalTime and the rest fTimeStep apart. pOut starts out silent and
+	// is added to the mix afterwards. By default this asks onUserSoundSample()
+	// for each sample in turn.
+	virtual void onUserSoundBlock(int nChannel, float fGlobalTime, float fTimeStep, float *pOut, unsigned int nFrames)
+	{
+		if (!m_bUserSoundSample)
+			return;
+		for (unsigned int i = 0; i < nFrames; i++)
+			pOut[i] = onUserSoundSample(nChannel, fGlobalTime + fTimeStep * i, fTimeStep);
+	}
+
+	// Overriden by user if they want to manipulate the sound before it is
+	// played, a block at a time: pSamples is the mix of nChannel for nFrames
+	// samples, to change in place. By default this passes each sample through
+	// onUserSoundFilter().
+	virtual void onUserFilterBlock(int nChannel, float fGlobalTime, float fTimeStep, float *pSamples, unsigned int nFrames)
+	{
+		if (!m_bUserSoundFilter)
+			return;
+		for (unsigned int i = 0; i < nFrames; i++)
+			pSamples[i] = onUserSoundFilter(nChannel, fGlobalTime + fTimeStep * i, pSamples[i]);
+	}
+
+	// Overridden by user if they want to generate sound in real-time. Prefer
+	// onUserSoundBlock(), which costs one call per block rather than one per
+	// sample.
 	virtual float onUserSoundSample(int nChannel, float fGlobalTime, float fTimeStep)
 	{
+		(void)nChannel; (void)fGlobalTime; (void)fTimeStep;
 		return 0.0f;
 	}
 
-	// Overriden by user if they want to manipulate the sound before it is played
+	// Overriden by user if they want to manipulate the sound before it is played.
+	// Prefer onUserFilterBlock().
 	virtual float onUserSoundFilter(int nChannel, float fGlobalTime, float fSample)
 	{
+		(void)nChannel; (void)fGlobalTime;
 		return fSample;
 	}
 
 	// The Sound Mixer - If the user wants to play many sounds simultaneously, and
 	// perhaps the same sound overlapping itself, then you need a mixer, which
 	// takes input from all sound sources for that audio frame. This mixer maintains
-	// a list of sound locations for all concurrently playing audio samples. Instead
-	// of duplicating audio data, we simply store the fact that a sound sample is in
-	// use and an offset into its sample data. As time progresses we update this offset
-	// until it is beyound the length of the sound sample it is attached to. At this
-	// point we remove the playing souind from the list.
+	// a pool of voices, the sound locations for all concurrently playing audio
+	// samples. Instead of duplicating audio data, we simply store the fact that a
+	// sound sample is in use and an offset into its sample data. A whole block is
+	// mixed at a time, one voice after another, each added into pMix in a single
+	// pass. A voice that has run past the end of its sample, and isn't looping,
+	// leaves the pool at the end of the block.
 	//
 	// Additionally, the users application may want to generate sound instead of just
 	// playing audio clips (think a synthesizer for example) in whcih case we also
@@ -1288,31 +3661,74 @@ protected: // Audio Engine =====================================================
 	// Finally, before the sound is issued to the operating system for performing, the
 	// user gets one final chance to "filter" the sound, perhaps changing the volume
 	// or adding funky effects
-	float GetMixerOutput(int nChannel, float fGlobalTime, float fTimeStep)
+	//
+	// pMix holds m_nChannels runs of nFrames samples, one channel after another.
+	void MixBlock(float *pMix, unsigned int nFrames, float fGlobalTime, float fTimeStep)
 	{
-		// Accumulate sample for this channel
-		float fMixerSample = 0.0f;
+		ApplyAudioCommands();
+		std::fill(pMix, pMix + nFrames * m_nChannels, 0.0f);
 
-		for (auto &s : listActiveSamples)
+		for (int v = 0; v < m_nActiveVoices;)
 		{
-			// Calculate sample position
-			s.nSamplePosition += (long)((float)vecAudioSamples[s.nAudioSampleID - 1].wavHeader.nSamplesPerSec * fTimeStep);
+			sVoice &voice = m_voices[v];
+
+			unsigned int nMixed = 0;
+			while (nMixed < nFrames && voice.nSamples > 0)
+			{
+				unsigned int n = (unsigned int)(std::min)((long)(nFrames - nMixed), voice.nSamples - voice.nSamplePosition);
+				MixSample(pMix + nMixed, nFrames, voice, n);
+				voice.nSamplePosition += n;
+				nMixed += n;
+
+				if (voice.nSamplePosition < voice.nSamples)
+					continue;
+				if (!voice.bLoop)
+					break;
+				voice.nSamplePosition = 0;
+			}
 
-			// If sample position is valid add to the mix
-			if (s.nSamplePosition < vecAudioSamples[s.nAudioSampleID - 1].nSamples)
-				fMixerSample += vecAudioSamples[s.nAudioSampleID - 1].fSample[(s.nSamplePosition * vecAudioSamples[s.nAudioSampleID - 1].nChannels) + nChannel];
+			// Finished, so the last voice takes its place
+			if ((voice.nSamplePosition >= voice.nSamples && !voice.bLoop) || voice.nSamples == 0)
+				voice = m_voices[--m_nActiveVoices];
 			else
-				s.bFinished = true; // Else sound has completed
+				v++;
 		}
 
-		// If sounds have completed then remove them
-		listActiveSamples.remove_if([](const sCurrentlyPlayingSample &s) {return s.bFinished; });
-
-		// The users application might be generating sound, so grab that if it exists
-		fMixerSample += onUserSoundSample(nChannel, fGlobalTime, fTimeStep);
+		// The users application might be generating sound, so grab that if it exists,
+		// then pass the mix through an optional user override to filter the sound
+		float *pUser = m_vecUserBlock.data();
+		for (unsigned int c = 0; c < m_nChannels; c++)
+		{
+			float *pChannel = pMix + c * nFrames;
+			std::fill(pUser, pUser + nFrames, 0.0f);
+			onUserSoundBlock(c, fGlobalTime, fTimeStep, pUser, nFrames);
+			for (unsigned int i = 0; i < nFrames; i++)
+				pChannel[i] += pUser[i];
+			onUserFilterBlock(c, fGlobalTime, fTimeStep, pChannel, nFrames);
+		}
+	}
 
-		// Return the sample via an optional user override to filter the sound
-		return onUserSoundFilter(nChannel, fGlobalTime, fMixerSample);
+	// Adds the next n frames of the voice's sample, at its volume, into each
+	// channel of pMix, nStride apart. Output channels beyond those the sample
+	// has repeat its channels, so a mono sample plays on both sides.
+	void MixSample(float *pMix, unsigned int nStride, const sVoice &voice, unsigned int n)
+	{
+		float fVolume = voice.fVolume;
+		for (unsigned int c = 0; c < m_nChannels; c++)
+		{
+			const float *pIn = voice.fSample + voice.nSamplePosition * voice.nChannels + c % voice.nChannels;
+			float *pOut = pMix + c * nStride;
+			if (voice.nChannels == 1)
+			{
+				for (unsigned int i = 0; i < n; i++)
+					pOut[i] += pIn[i] * fVolume;
+			}
+			else
+			{
+				for (unsigned int i = 0; i < n; i++)
+					pOut[i] += pIn[i * voice.nChannels] * fVolume;
+			}
+		}
 	}
 
 	unsigned int m_nSampleRate;
@@ -1322,8 +3738,17 @@ protected: // Audio Engine =====================================================
 	unsigned int m_nBlockCurrent;
 
 	short* m_pBlockMemory = nullptr;
+	std::vector<float> m_vecMixBlock;
+	std::vector<float> m_vecUserBlock;
+
+	// Whether the default block hooks call the per-sample ones, see
+	// SetPerSampleSoundHooks()
+	bool m_bUserSoundSample = true;
+	bool m_bUserSoundFilter = true;
+#ifdef _WIN32
 	WAVEHDR *m_pWaveHeaders = nullptr;
 	HWAVEOUT m_hwDevice = nullptr;
+#endif
 
 	std::thread m_AudioThread;
 	std::atomic<bool> m_bAudioThreadActive = false;
@@ -1358,13 +3783,19 @@ public:
 protected:
 	int Error(const wchar_t *msg)
 	{
+#ifndef _WIN32
+		fwprintf(stderr, L"ERROR: %ls\n", msg);
+		return 0;
+#else
 		wchar_t buf[256];
 		FormatMessage(FORMAT_MESSAGE_FROM_SYSTEM, NULL, GetLastError(), MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), buf, 256, NULL);
 		SetConsoleActiveScreenBuffer(m_hOriginalConsole);
 		wprintf(L"ERROR: %s\n\t%s\n", msg, buf);
 		return 0;
+#endif
 	}
 
+#ifdef _WIN32
 	static BOOL CloseHandler(DWORD evt)
 	{
 		// Note this gets called in a seperate OS thread, so it must
@@ -1380,23 +3811,97 @@ protected:
 		}
 		return true;
 	}
+#endif
 
 protected:
 	int m_nScreenWidth;
 	int m_nScreenHeight;
-	CHAR_INFO *m_bufScreen;
+	CHAR_INFO *m_bufScreen = nullptr;
+	float *m_bufDepth = nullptr;
+	bool m_bDrawSpans = false;	// see EnableSpanDrawing()
 	std::wstring m_sAppName;
+#ifdef _WIN32
 	HANDLE m_hOriginalConsole;
 	CONSOLE_SCREEN_BUFFER_INFO m_OriginalConsoleInfo;
 	HANDLE m_hConsole;
 	HANDLE m_hConsoleIn;
 	SMALL_RECT m_rectWindow;
-	short m_keyOldState[256] = { 0 };
-	short m_keyNewState[256] = { 0 };
-	bool m_mouseOldState[5] = { 0 };
-	bool m_mouseNewState[5] = { 0 };
+#endif
 	bool m_bConsoleInFocus = true;	
 	bool m_bEnableSound = false;
+	bool m_bHeadless = false;
+	int m_nHeadlessFrames = 0;
+	float m_fHeadlessTimeStep = 1.0f / 60.0f;
+
+	// Frame pacing. m_fFrameIntervals is a ring of the last nPacingFrames
+	// elapsed times, in seconds.
+	static const int nPacingFrames = 120;
+	static const int nMaxFixedSteps = 8;
+	float m_fTargetFrameTime = 0.0f;
+	float m_fFixedTimeStep = 0.0f;
+	double m_fFixedAccumulator = 0.0;
+	float m_fFixedAlpha = 0.0f;
+	float m_fFrameIntervals[nPacingFrames] = { 0 };
+	uint64_t m_nPacingCount = 0;
+
+	// Terminal presenter state. m_bufPresented is what the terminal is showing,
+	// and the cursor and colour are where the last frame left them, or -1 when
+	// not known.
+	bool m_bTerminal = false;
+	CHAR_INFO *m_bufPresented = nullptr;
+	std::string m_sTerminalFrame;
+	int m_nTerminalX = -1;
+	int m_nTerminalY = -1;
+	int m_nTerminalAttr = -1;
+	// Written by the present thread, read by the game thread for statistics
+	std::atomic<uint64_t> m_nTerminalBytes{ 0 };
+	std::atomic<uint64_t> m_nTerminalBytesTotal{ 0 };
+	std::atomic<uint64_t> m_nTerminalFrames{ 0 };
+
+	// Present thread state, see SubmitFrame(). Everything but m_bufScreen and
+	// m_nDrawing is only touched with m_muxPresent held.
+	static const int nScreenBuffers = 3;
+	enum { BUFFER_FREE, BUFFER_DRAWING, BUFFER_QUEUED, BUFFER_PRESENTING };
+	CHAR_INFO *m_bufScreens[nScreenBuffers] = { nullptr };
+	int m_nBufferState[nScreenBuffers] = { BUFFER_FREE };
+	int m_nDrawing = 0;
+	struct sQueuedFrame
+	{
+		int nBuffer;
+		float fElapsedTime;
+		uint64_t nInputTime;	// Oldest input the frame responded to, or 0
+	};
+	sQueuedFrame m_queue[nScreenBuffers] = {};
+	int m_nQueued = 0;
+	uint64_t m_nFramesDropped = 0;
+	bool m_bPresenting = false;
+	bool m_bPresentStop = false;
+	std::thread m_threadPresent;
+	std::mutex m_muxPresent;
+	std::condition_variable m_cvPresent;
+#ifdef _WIN32
+	bool m_bTimerPeriod = false;	// timeBeginPeriod(1) is in effect
+#endif
+
+	// Input thread state. m_nKeyChanged lists the m_nKeysChanged keys pressed
+	// or released last frame, so only they need clearing. The terminal reader
+	// keeps its own state, on the input thread.
+	olcInputQueue m_input;
+	std::thread m_threadInput;
+	std::atomic<bool> m_bInputStop{ false };
+	uint8_t m_nKeyChanged[256] = { 0 };
+	int m_nKeysChanged = 0;
+	uint64_t m_nFrameInputTime = 0;
+	std::atomic<float> m_fInputToPhotonMs{ 0.0f };
+#ifndef _WIN32
+	bool m_bTerminalInput = false;
+	termios m_termiosOriginal;
+	uint64_t m_nKeyHeldUntil[256] = { 0 };
+	int m_nTerminalMouseX = -1;
+	int m_nTerminalMouseY = -1;
+#endif
+
+	olcRecordingWriter m_recorder;
 
 	// These need to be static because of the OnDestroy call the OS may make. The OS
 	// spawns a special thread just for that
@@ -0,0 +1,129 @@
+#include "../ConsoleEngine3D/olcConsoleGameEngine.h"
+
+#include <filesystem>
+#include <cstdio>
+#include <cstring>
+
+// Plays back a recording made with olcConsoleGameEngine::StartRecording(),
+// either at the speed it was recorded or one frame per update as fast as the
+// frames can be decoded.
+//
+//	RecordingPlayer <file> [--fast] [--headless <sprite file>]
+//
+// --headless decodes every frame without showing any, then saves the last one
+// as a sprite, for comparing a run against an earlier one. Either way the
+// decoding time and size per frame are printed at the end.
+class RecordingPlayer : public olcConsoleGameEngine
+{
+public:
+	RecordingPlayer(olcRecordingReader &reader, bool bFast) : reader(reader), bFast(bFast)
+	{
+		m_sAppName = L"Recording Player";
+	}
+
+	size_t nFramesShown = 0;
+	double fDecodeMs = 0.0;
+
+private:
+	olcRecordingReader &reader;
+	bool bFast;
+	double fPlayTime = 0.0;
+	size_t nNextFrame = 0;
+
+	bool OnUserCreate() override
+	{
+		return reader.FrameCount() > 0;
+	}
+
+	bool OnUserUpdate(float fElapsedTime) override
+	{
+		if (nNextFrame >= reader.FrameCount())
+			return false;
+
+		// At the recorded speed, show the latest frame that is due and skip
+		// any others, the way the original screen would have
+		size_t nFrame = nNextFrame;
+		if (!bFast)
+		{
+			fPlayTime += fElapsedTime;
+			if (reader.FrameTime(nFrame) > fPlayTime)
+				return true;
+			while (nFrame + 1 < reader.FrameCount() && reader.FrameTime(nFrame + 1) <= fPlayTime)
+				nFrame++;
+		}
+
+		auto tp1 = std::chrono::steady_clock::now();
+		bool bOk = reader.ReadFrame(nFrame, m_bufScreen);
+		fDecodeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tp1).count();
+
+		nFramesShown++;
+		nNextFrame = nFrame + 1;
+		return bOk;
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	const char *sUsage = "Usage: RecordingPlayer <file> [--fast] [--headless <sprite file>]\n";
+	if (argc < 2)
+	{
+		fprintf(stderr, "%s", sUsage);
+		return 1;
+	}
+
+	bool bFast = false;
+	const char *sHeadless = nullptr;
+	for (int i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--fast") == 0)
+			bFast = true;
+		else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc)
+			sHeadless = argv[++i];
+		else
+		{
+			fprintf(stderr, "%s", sUsage);
+			return 1;
+		}
+	}
+
+	olcRecordingReader reader;
+	if (!reader.Open(std::filesystem::path(argv[1]).wstring()))
+	{
+		fprintf(stderr, "Cannot read recording %s\n", argv[1]);
+		return 1;
+	}
+
+	// Headless there is no display to keep time with, so every frame is decoded
+	RecordingPlayer player(reader, bFast || sHeadless != nullptr);
+	if (!bFast)
+		player.SetTargetFrameRate(120.0f);	// Plenty to show frames on time, without spinning in between
+	int nWidth = reader.Width(), nHeight = reader.Height();
+
+	int nConstructed;
+	if (sHeadless != nullptr)
+		nConstructed = player.ConstructHeadless(nWidth, nHeight, (int)reader.FrameCount());
+	else
+	{
+#ifdef _WIN32
+		// Keep the window about 1000 pixels across
+		int nFont = (std::max)(2, (std::min)(16, 1024 / nWidth));
+		nConstructed = player.ConstructConsole(nWidth, nHeight, nFont, nFont);
+#else
+		nConstructed = player.ConstructTerminal(nWidth, nHeight);
+#endif
+	}
+	if (!nConstructed)
+		return 1;
+
+	player.Start();
+
+	uintmax_t nFileBytes = std::filesystem::file_size(argv[1]);
+	printf("%zu of %zu frames shown, %.3f ms to decode each, %.2f KB per frame in the file\n",
+		player.nFramesShown, reader.FrameCount(), player.nFramesShown ? player.fDecodeMs / player.nFramesShown : 0.0,
+		(double)nFileBytes / 1024.0 / (double)reader.FrameCount());
+
+	if (sHeadless != nullptr && !player.SaveScreen(std::filesystem::path(sHeadless).wstring()))
+		return 1;
+
+	return 0;
+}